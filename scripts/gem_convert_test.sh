@@ -0,0 +1,47 @@
+#!/bin/bash
+
+echo "Use: provide the path to source directory as argument"
+echo "gem-convert round trip: a good record is verified, a token wider than its field fails the file"
+
+# GEMCONVERT=path uses an already built gem-convert
+exe=${GEMCONVERT:-$PWD/gem-convert-test}
+if [ -z "$GEMCONVERT" ]; then
+  g++ -O2 -std=c++0x -pthread -I /usr/include/root -I $1 $1/gem-convert.cc `root-config --libs` -o $exe || exit 1
+fi
+
+dir=`mktemp -d`
+trap "/bin/rm -rf $dir" EXIT
+
+# one GEB record: header ChamID 0xdea sumVFAT 1, BC EC ChipID lsData msData crc, trailer
+record() {
+  printf "dea0000001\n%s\n%s\n%s\n0\n0\n%s\n1\n" $1 $2 $3 $4
+}
+
+failed=0
+check() {
+  $exe --out $dir/out.bin $dir/$1.dat > $dir/$1.log
+  status=$?
+  if [ $status -ne $2 ]; then
+    echo "FAILED: $1 exit $status, expected $2"
+    cat $dir/$1.log
+    failed=1
+  else
+    echo "ok: $1"
+  fi
+}
+
+record a1e2  c7ed  ec2c  c9e9  >  $dir/good.dat
+record a1e2  c7ed  ec2c  c9e9  >> $dir/good.dat
+check good 0
+
+record a1e2  c7ed  ec2c  c9e9  >  $dir/wideBC.dat
+record 1a1e2 c7ed  ec2c  c9e9  >> $dir/wideBC.dat
+check wideBC 2
+
+record a1e2  c7ed  1ec2c c9e9  >  $dir/wideChipID.dat
+check wideChipID 2
+
+record a1e2  c7ed  ec2c  1c9e9 >  $dir/wideCRC.dat
+check wideCRC 2
+
+exit $failed
@@ -68,6 +68,15 @@
 //        Int_t          fRun;
 //        Int_t          fDate;
 //
+//  VFATdata and GEBdata have hand-written streamers (version 2): a GEB is its
+//  header and trailer word followed by one packed 22 byte record per VFAT2
+//  frame. Files written with the member-wise version 1 are still read.
+//
+//  The EventFlat class holds the same data column by column: one vector per
+//  VFAT2 field (ChipID, EC, BC, Flags, CRC, lsData, msData) over all frames of
+//  the event, and gebOffset[i] the index of the first frame of GEB i. Split,
+//  each field is a branch of its own and can be read without the others.
+//
 //  There's also a placeholder for the histogram maker. More details can be found in the Event.cxx ROOT example.
 //  A good example of how to fill the tree with events is provided here:
 //  https://root.cern.ch/root/html/tutorials/tree/tree4.C.html
@@ -78,13 +87,19 @@
 #include "TRandom.h"
 #include "TDirectory.h"
 #include "TProcessID.h"
+#include "TTree.h"
+#include "TBuffer.h"
+
+#include <string>
 
 #include "Event.h"
+#include "GEMBitFields.h"
 
 
 //ClassImp(Track)
 ClassImp(EventHeader)
 ClassImp(Event)
+ClassImp(EventFlat)
 //ClassImp(HistogramManager)
 
 //TH1F *Event::fgHist = 0;
@@ -157,6 +172,11 @@ void Event::Clear()
     DAVCount = 0;
     FormatVer = 0;
     MP7BordStat = 0;
+    // the GEBdata go back to the pool with their vfats capacity, gebs keeps its own capacity
+    for (size_t i = 0; i < gebs.size(); ++i) {
+        fGEBPool.push_back(GEBdata());
+        fGEBPool.back().swap(gebs[i]);
+    }
     gebs.clear();
     EventStat = 0;
     GEBerrFlag = 0;
@@ -166,6 +186,203 @@ void Event::Clear()
     DataLgthT = -1;
 }
 
+//______________________________________________________________________________
+GEBdata& Event::newGEBdata(const uint64_t &ZSFlag_, const uint64_t &ChamID_)
+{
+    gebs.push_back(GEBdata());
+    GEBdata &geb = gebs.back();
+    if (!fGEBPool.empty()) {
+        geb.swap(fGEBPool.back());
+        fGEBPool.pop_back();
+    }
+    geb.Clear();
+    geb.setHeader(ZSFlag_, ChamID_);
+    nGEBs = gebs.size();
+    return geb;
+}
+
+// Packed VFAT2 record, the control nibbles and Flag share one word, crcOK is bit 15 of the ChipID word
+namespace {
+  typedef GEMBitField<uint16_t, 12,  4> Packed1010;
+  typedef GEMBitField<uint16_t,  8,  4> Packed1100;
+  typedef GEMBitField<uint16_t,  4,  4> Packed1110;
+  typedef GEMBitField<uint16_t,  0,  4> PackedFlag;
+  typedef GEMBitField<uint16_t, 15,  1> PackedCrcOK;
+  typedef GEMBitField<uint16_t,  0, 12> PackedChipID;
+}
+
+//______________________________________________________________________________
+void VFATdata::WritePacked(TBuffer &b) const
+{
+   UShort_t control = Packed1010::make(b1010) | Packed1100::make(b1100) | Packed1110::make(b1110) | PackedFlag::make(Flag);
+   UShort_t chip    = PackedCrcOK::make(crcOK) | PackedChipID::make(ChipID);
+   b << control << chip << UShort_t(crc) << ULong64_t(lsData) << ULong64_t(msData);
+}
+
+//______________________________________________________________________________
+void VFATdata::ReadPacked(TBuffer &b)
+{
+   UShort_t control, chip, crc_;
+   ULong64_t lsData_, msData_;
+   b >> control >> chip >> crc_ >> lsData_ >> msData_;
+   b1010  = Packed1010::get(control);
+   b1100  = Packed1100::get(control);
+   b1110  = Packed1110::get(control);
+   Flag   = PackedFlag::get(control);
+   crcOK  = PackedCrcOK::get(chip);
+   ChipID = PackedChipID::get(chip);
+   crc    = crc_;
+   lsData = lsData_;
+   msData = msData_;
+}
+
+//______________________________________________________________________________
+void VFATdata::Streamer(TBuffer &R__b)
+{
+   // Stream a VFATdata, version 1 is the member-wise layout.
+
+   if (R__b.IsReading()) {
+      UInt_t R__s, R__c;
+      Version_t R__v = R__b.ReadVersion(&R__s, &R__c);
+      if (R__v < 2) {
+         R__b.ReadClassBuffer(VFATdata::Class(), this, R__v, R__s, R__c);
+         return;
+      }
+      ReadPacked(R__b);
+      R__b.CheckByteCount(R__s, R__c, VFATdata::Class());
+   } else {
+      UInt_t R__c = R__b.WriteVersion(VFATdata::Class(), kTRUE);
+      WritePacked(R__b);
+      R__b.SetByteCount(R__c, kTRUE);
+   }
+}
+
+//______________________________________________________________________________
+void GEBdata::Streamer(TBuffer &R__b)
+{
+   // Stream a GEBdata: the GEB header and trailer words, then the packed
+   // vfats without a version of their own. Version 1 is the member-wise layout.
+
+   if (R__b.IsReading()) {
+      UInt_t R__s, R__c;
+      Version_t R__v = R__b.ReadVersion(&R__s, &R__c);
+      if (R__v < 2) {
+         R__b.ReadClassBuffer(GEBdata::Class(), this, R__v, R__s, R__c);
+         return;
+      }
+      ULong64_t header, trailer;
+      R__b >> header >> trailer;
+      ZSFlag     = GEMBits::GEBHeader::ZSFlag::get(header);
+      ChamID     = GEMBits::GEBHeader::ChamID::get(header);
+      OHcrc      = GEMBits::GEBTrailer::OHcrc::get(trailer);
+      OHwCount   = GEMBits::GEBTrailer::OHwCount::get(trailer);
+      ChamStatus = GEMBits::GEBTrailer::ChamStatus::get(trailer);
+      vfats.resize(GEMBits::GEBHeader::SumVFAT::get(header));
+      for (size_t i = 0; i < vfats.size(); ++i) vfats[i].ReadPacked(R__b);
+      R__b.CheckByteCount(R__s, R__c, GEBdata::Class());
+   } else {
+      UInt_t R__c = R__b.WriteVersion(GEBdata::Class(), kTRUE);
+      ULong64_t header  = GEMBits::GEBHeader::ZSFlag::make(ZSFlag) | GEMBits::GEBHeader::ChamID::make(ChamID) |
+                          GEMBits::GEBHeader::SumVFAT::make(vfats.size());
+      ULong64_t trailer = GEMBits::GEBTrailer::OHcrc::make(OHcrc) | GEMBits::GEBTrailer::OHwCount::make(OHwCount) |
+                          GEMBits::GEBTrailer::ChamStatus::make(ChamStatus);
+      R__b << header << trailer;
+      for (size_t i = 0; i < vfats.size(); ++i) vfats[i].WritePacked(R__b);
+      R__b.SetByteCount(R__c, kTRUE);
+   }
+}
+
+//______________________________________________________________________________
+EventFlat::EventFlat()
+{
+   // Create an empty columnar event.
+
+   Clear();
+}
+
+//______________________________________________________________________________
+EventFlat::~EventFlat()
+{
+   Clear();
+}
+
+//______________________________________________________________________________
+void EventFlat::SetHeader(Int_t i, Int_t run, Int_t date)
+{
+   fEvtHdr.Set(i, run, date);
+}
+
+//______________________________________________________________________________
+void EventFlat::Clear()
+{
+    // vectors keep their capacity, filling the next event does not allocate
+    nGEBs = 0;
+    gebOffset.clear();
+    gebOffset.push_back(0);
+    ZSFlag.clear();
+    ChamID.clear();
+    OHcrc.clear();
+    OHwCount.clear();
+    ChamStatus.clear();
+    ChipID.clear();
+    EC.clear();
+    BC.clear();
+    Flags.clear();
+    CRC.clear();
+    lsData.clear();
+    msData.clear();
+}
+
+//______________________________________________________________________________
+void EventFlat::addGEB(const uint64_t &ZSFlag_, const uint16_t &ChamID_)
+{
+    nGEBs++;
+    gebOffset.push_back(gebOffset.back());
+    ZSFlag.push_back(ZSFlag_);
+    ChamID.push_back(ChamID_);
+    OHcrc.push_back(0);
+    OHwCount.push_back(0);
+    ChamStatus.push_back(0);
+}
+
+//______________________________________________________________________________
+void EventFlat::setTrailer(const uint16_t &OHcrc_, const uint16_t &OHwCount_, const uint16_t &ChamStatus_)
+{
+    OHcrc.back() = OHcrc_;
+    OHwCount.back() = OHwCount_;
+    ChamStatus.back() = ChamStatus_;
+}
+
+//______________________________________________________________________________
+void EventFlat::addVFAT(const uint16_t &BC_, const uint8_t &EC_, const uint8_t &Flag_, const uint16_t &ChipID_, const uint16_t &crc_, const bool &crcOK_, const uint64_t &lsData_, const uint64_t &msData_)
+{
+    gebOffset.back()++;
+    BC.push_back(BC_);
+    EC.push_back(EC_);
+    Flags.push_back((Flag_ & 0xf) | (crcOK_ ? kCrcOK : 0));
+    ChipID.push_back(ChipID_);
+    CRC.push_back(crc_);
+    lsData.push_back(lsData_);
+    msData.push_back(msData_);
+}
+
+//______________________________________________________________________________
+void EventFlat::SelectColumns(TTree *tree, const char *branch, const char *columns)
+{
+    // Disable all branches of the tree, then enable branch+column for every
+    // column in the list, e.g. ("GEMFlat.", "lsData msData").
+
+    tree->SetBranchStatus("*", 0);
+    std::string list(columns);
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(' ', pos);
+        if (end == std::string::npos) end = list.size();
+        if (end > pos) tree->SetBranchStatus((std::string(branch) + list.substr(pos, end - pos)).c_str(), 1);
+        pos = end + 1;
+    }
+}
+
 /*
 HistogramManager::HistogramManager(TDirectory *dir)
 {
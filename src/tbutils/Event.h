@@ -20,6 +20,9 @@ typedef char __signed;
 #include <stdint.h> 
 #endif
 
+#include <utility>
+#include <vector>
+
 #include "TObject.h"
 #include "TClonesArray.h"
 #include "TRefArray.h"
@@ -27,6 +30,7 @@ typedef char __signed;
 #include "TH1.h"
 #include "TBits.h"
 #include "TMath.h"
+#include "RVersion.h"
 
 //#include "/usr/include/sys/_types/_int8_t.h"
 //#include "stdint.h"
@@ -51,11 +55,12 @@ class VFATdata {
         uint8_t Flag;
         uint8_t b1110;
         uint16_t crc;                   // :16
-        uint64_t lsData;                // channels from 1to64 // SHOULD WE HAVE AN ARRAY HERE?
-        uint64_t msData;                // channels from 65to128
+        uint64_t lsData;                // channels from 1to64, bit ch
+        uint64_t msData;                // channels from 65to128, bit ch-64
+        bool crcOK;                     // crc agrees with the CRC-16 of BC, EC, ChipID and data, GEMCrc16.h
 
      public:
-        VFATdata(){}
+        VFATdata() : lsData(0), msData(0), crcOK(false) {}
 //        VFATdata(const uint16_t &BC_, const uint16_t &EC_, const char &ChipID_, const uint64_t &lsData_, const uint64_t &msData_, const uint16_t &crc_) : 
 //            BC(BC_),
 //            EC(EC_),
@@ -64,13 +69,17 @@ class VFATdata {
 //            msData(msData_),
 //            crc(crc_) {}
 
-        VFATdata(const uint8_t &b1010_, const uint8_t &b1100_, const uint16_t &ChipID_, const uint8_t &Flag_, const uint8_t &b1110_, const uint16_t &crc_) : 
+        VFATdata(const uint8_t &b1010_, const uint8_t &b1100_, const uint16_t &ChipID_, const uint8_t &Flag_, const uint8_t &b1110_, const uint16_t &crc_,
+                 const uint64_t &lsData_ = 0, const uint64_t &msData_ = 0) : 
             b1010(b1010_),
             b1100(b1100_),
             ChipID(ChipID_),
             Flag(Flag_),
             b1110(b1110_),
-            crc(crc_) {}
+            crc(crc_),
+            lsData(lsData_),
+            msData(msData_),
+            crcOK(false) {}
          //virtual ~VFATdata();
            ~VFATdata(){}
         // setters
@@ -88,8 +97,43 @@ class VFATdata {
 //        uint64_t getlsData() {return lsData;}
 //        uint64_t getmsData() {return msData;}
 //        uint16_t getCrc(){return crc;}
-
-        //ClassDef(VFATdata,1);
+        void setCrcOK(const bool crcOK_){crcOK = crcOK_;}
+        bool getCrcOK() const {return crcOK;}
+        void setData(const uint64_t lsData_, const uint64_t msData_){lsData = lsData_; msData = msData_;}
+        uint64_t getlsData() const {return lsData;}
+        uint64_t getmsData() const {return msData;}
+
+        // channel hits, channel ch in 0..127 is bit ch of msData:lsData
+        //! Number of fired channels.
+        int popcount() const {return __builtin_popcountll(lsData) + __builtin_popcountll(msData);}
+        //! Channel ch fired.
+        bool test(const int ch) const {return ((ch < 64 ? lsData >> ch : msData >> (ch - 64)) & 0x1) != 0;}
+
+        //! Fired channels in increasing order, one count-trailing-zeros per hit.
+        /*!
+          for(VFATdata::Hits h = vfat.hits(); !h.done(); h.next()) use(h.channel());
+         */
+        class Hits {
+            public:
+                Hits(const uint64_t ls, const uint64_t ms) : w0(ls), w1(ms) {}
+                bool done() const {return (w0 | w1) == 0;}
+                int channel() const {return w0 ? __builtin_ctzll(w0) : 64 + __builtin_ctzll(w1);}
+                void next() {if(w0) w0 &= w0 - 1; else w1 &= w1 - 1;}
+            private:
+                uint64_t w0, w1;
+        };
+        Hits hits() const {return Hits(lsData, msData);}
+
+        // Packed record of the custom streamer, 22 bytes: control nibbles and Flag, crcOK and ChipID, crc, lsData, msData
+        void WritePacked(TBuffer &b) const;
+        void ReadPacked(TBuffer &b);
+
+        // version 1: member-wise streamer of the + LinkDef entry, read by schema evolution
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+        ClassDefNV(VFATdata,2)          //VFAT2 frame, packed
+#else
+        ClassDef(VFATdata,2)            //VFAT2 frame, packed
+#endif
 };
 
 //class GEBdata : public TObject {
@@ -130,9 +174,26 @@ class GEBdata {
 
         void addVFATData(const VFATdata &vfat_){vfats.push_back(vfat_);}
 
+        void setHeader(const uint64_t &ZSFlag_, const uint64_t &ChamID_){ZSFlag = ZSFlag_; ChamID = ChamID_;}
+        void Clear(){vfats.clear();}    // vfats keeps its capacity
+        //! Exchange contents without copying vfats, the destructor above suppresses the implicit move.
+        void swap(GEBdata &other){
+            std::swap(ZSFlag, other.ZSFlag); std::swap(ChamID, other.ChamID); vfats.swap(other.vfats);
+            std::swap(OHcrc, other.OHcrc); std::swap(OHwCount, other.OHwCount); std::swap(ChamStatus, other.ChamStatus);
+        }
+
         void setTrailer(const uint64_t &OHcrc_, const uint64_t &OHwCount_, const uint64_t &ChamStatus_){OHcrc = OHcrc_; OHwCount = OHwCount_; ChamStatus = ChamStatus_;}
 
-        //ClassDef(GEBdata,1);
+        uint64_t getChamID() const {return ChamID;}
+        const std::vector<VFATdata>& getVFATs() const {return vfats;}
+
+        // version 1: member-wise streamer of the + LinkDef entry, read by schema evolution
+        // version 2: GEB header word (ZSFlag, ChamID, number of vfats), GEB trailer word, packed vfats
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+        ClassDefNV(GEBdata,2)           //GEB record, packed
+#else
+        ClassDef(GEBdata,2)             //GEB record, packed
+#endif
 };
 
 class EventHeader {
@@ -176,6 +237,7 @@ class Event : public TObject {
         uint8_t MP7BordStat;
 
         std::vector<GEBdata> gebs;      // Should we use vector or better have TClonesArray here?
+        std::vector<GEBdata> fGEBPool;  //! GEBdata of previous events recycled by newGEBdata(), not written
         //uint64_t trailer2;            // EventStat:32 GEBerrFlag:24  
         uint32_t EventStat;
         uint32_t GEBerrFlag;
@@ -194,7 +256,14 @@ class Event : public TObject {
         void Build(const short &AmcNo_, const Int_t &LV1ID_, const Int_t &BXID_, const Int_t &DataLgth_, const uint16_t &OrN_, const char &BoardID_, const uint32_t &DAVList_, const uint32_t &BufStat_, const uint8_t &DAVCount_, const unsigned char &FormatVer_, const uint8_t &MP7BordStat_, const uint32_t &EventStat_, const uint32_t &GEBerrFlag_, const uint32_t &crc_, const uint8_t &LV1IDT_, const Int_t &DataLgthT_);
         //void Build(const short &AmcNo_, const Int_t &LV1ID_, const Int_t &BXID_, const Int_t &DataLgth_, const uint16_t &OrN_, const char &BoardID_, const uint32_t &DAVList_, const uint32_t &BufStat_, const uint8_t &DAVCount_, const unsigned char &FormatVer_, const uint8_t &MP7BordStat_, const std::vector<GEBdata> &gebs_, const uint32_t &EventStat_, const uint32_t &GEBerrFlag_, const uint32_t &crc_, const uint8_t &LV1IDT_, const Int_t &DataLgthT_);
         void addGEBdata(const GEBdata &geb){gebs.push_back(geb); nGEBs = gebs.size();}
+        //! Append a GEB taken from the pool, no allocation once the pool has warmed up. Fill its vfats in place.
+        GEBdata& newGEBdata(const uint64_t &ZSFlag_, const uint64_t &ChamID_);
         void Clear();
+
+        Int_t GetLV1ID() const {return LV1ID;}
+        Int_t GetBXID() const {return BXID;}
+        Int_t GetNGEBs() const {return nGEBs;}
+        const std::vector<GEBdata>& GetGEBs() const {return gebs;}
 /*
  ____  _        _    ____ _____ _   _  ___  _     ____  _____ ____  
 |  _ \| |      / \  / ___| ____| | | |/ _ \| |   |  _ \| ____|  _ \
@@ -206,6 +275,74 @@ class Event : public TObject {
         ClassDef(Event,1)               //Event structure
 };
 
+//! Columnar GEM event.
+/*!
+  The same content as Event/GEBdata/VFATdata without the nested vectors:
+  every VFAT2 field is one contiguous array over all frames of the event and
+  the frames of GEB i are [gebOffset[i], gebOffset[i+1]). Written with split
+  level 99 each array gets its own branch and baskets, an occupancy study
+  reads lsData/msData only:
+
+    EventFlat::SelectColumns(tree, "GEMFlat.", "lsData msData gebOffset");
+*/
+
+class TTree;
+
+class EventFlat : public TObject {
+
+    private:
+        EventHeader    fEvtHdr;
+        Int_t nGEBs;                          // Number of GEBs
+        std::vector<UInt_t>    gebOffset;     // nGEBs+1 entries, first frame of each GEB, then the number of frames
+
+        // per GEB
+        std::vector<ULong64_t> ZSFlag;        // ZSFlag:24
+        std::vector<UShort_t>  ChamID;        // ChamID:12
+        std::vector<UShort_t>  OHcrc;         // OHcrc:16
+        std::vector<UShort_t>  OHwCount;      // OHwCount:16
+        std::vector<UShort_t>  ChamStatus;    // ChamStatus:16
+
+        // per VFAT2 frame
+        std::vector<UShort_t>  ChipID;        // ChipID:12
+        std::vector<UChar_t>   EC;            // EC:8
+        std::vector<UShort_t>  BC;            // BC:12
+        std::vector<UChar_t>   Flags;         // Flag:4, bit 4 crc OK
+        std::vector<UShort_t>  CRC;           // crc:16
+        std::vector<ULong64_t> lsData;        // channels from 1to64
+        std::vector<ULong64_t> msData;        // channels from 65to128
+
+    public:
+        static const UChar_t kCrcOK = 0x10;
+
+        EventFlat();
+        virtual ~EventFlat();
+        void SetHeader(Int_t i, Int_t run, Int_t date);
+        void Clear();
+
+        //! Start the next GEB, the following addVFAT() calls belong to it.
+        void addGEB(const uint64_t &ZSFlag_, const uint16_t &ChamID_);
+        void setTrailer(const uint16_t &OHcrc_, const uint16_t &OHwCount_, const uint16_t &ChamStatus_);
+        void addVFAT(const uint16_t &BC_, const uint8_t &EC_, const uint8_t &Flag_, const uint16_t &ChipID_, const uint16_t &crc_, const bool &crcOK_, const uint64_t &lsData_, const uint64_t &msData_);
+
+        Int_t  GetNGEBs()  const { return nGEBs; }
+        UInt_t GetNVFATs() const { return gebOffset.back(); }
+        UInt_t GetFirstVFAT(Int_t igeb) const { return gebOffset[igeb]; }
+        UInt_t GetEndVFAT(Int_t igeb)   const { return gebOffset[igeb+1]; }
+
+        const std::vector<UShort_t>&  GetChipID() const { return ChipID; }
+        const std::vector<UChar_t>&   GetEC()     const { return EC; }
+        const std::vector<UShort_t>&  GetBC()     const { return BC; }
+        const std::vector<UChar_t>&   GetFlags()  const { return Flags; }
+        const std::vector<UShort_t>&  GetCRC()    const { return CRC; }
+        const std::vector<ULong64_t>& GetlsData() const { return lsData; }
+        const std::vector<ULong64_t>& GetmsData() const { return msData; }
+
+        //! Read only the given space separated members of the EventFlat branch "branch" (with its trailing dot).
+        static void SelectColumns(TTree *tree, const char *branch, const char *columns);
+
+        ClassDef(EventFlat,1)           //Columnar event structure
+};
+
 
 /*
 class HistogramManager {
@@ -6,7 +6,8 @@
 
 #pragma link C++ class EventHeader+;
 #pragma link C++ class Event+;
-#pragma link C++ class VFATdata+;
-#pragma link C++ class GEBdata+;
+#pragma link C++ class VFATdata-;
+#pragma link C++ class GEBdata-;
+#pragma link C++ class EventFlat+;
 
 #endif
@@ -0,0 +1,169 @@
+#ifndef GEM_BinaryReader
+#define GEM_BinaryReader
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMBinaryReader                                                      //
+//                                                                      //
+// Memory-mapped reader of the binary GEB/VFAT stream written by        //
+// GEMOnline::write*Binary (gem-re-write.cc)                            //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <cstring>
+#include <string>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//! Binary GEB data reader.
+/*!
+  \brief GEMBinaryReader
+  maps the whole file into memory and decodes GEB header, VFAT2 frames and
+  GEB trailer straight from the mapped bytes. The record layout is the one
+  of gem-re-write.cc, host byte order, no padding:
+
+    GEB header   uint64_t        ZSFlag:24 ChamID:12 sumVFAT:28
+    VFAT2 frame  uint16_t BC, uint16_t EC, uint16_t ChipID,
+                 uint64_t lsData, uint64_t msData, uint16_t crc   (24 bytes)
+    GEB trailer  uint64_t        OHcrc:16 OHwCount:16 ChamStatus:16
+ */
+
+class GEMBinaryReader {
+  public:
+    static const size_t kGEBheaderSize  = 8;
+    static const size_t kGEBtrailerSize = 8;
+    static const size_t kVFATSize       = 24;
+
+    //! Zero-copy view of one VFAT2 frame inside the mapped file.
+    struct VFATRecord {
+      const unsigned char* p;
+      uint16_t BC()     const { return load16(p);      }
+      uint16_t EC()     const { return load16(p + 2);  }
+      uint16_t ChipID() const { return load16(p + 4);  }
+      uint64_t lsData() const { return load64(p + 6);  }
+      uint64_t msData() const { return load64(p + 14); }
+      uint16_t crc()    const { return load16(p + 22); }
+    };
+
+    GEMBinaryReader() : fd(-1), base(0), fSize(0), fEnd(0), pos(0), fMapped(false) {}
+    explicit GEMBinaryReader(const std::string& file) : fd(-1), base(0), fSize(0), fEnd(0), pos(0), fMapped(false) { open(file); }
+    ~GEMBinaryReader(){ close(); }
+
+    //! Map the file, returns false if it can not be opened or mapped.
+    bool open(const std::string& file){
+      close();
+      fd = ::open(file.c_str(), O_RDONLY);
+      if(fd < 0) return(false);
+      struct stat st;
+      if(fstat(fd, &st) != 0){ close(); return(false); }
+      fSize = fEnd = st.st_size;
+      if(fSize == 0) return(true);
+      void* m = mmap(0, fSize, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(m == MAP_FAILED){ close(); return(false); }
+      base = static_cast<const unsigned char*>(m);
+      fMapped = true;
+      madvise(m, fSize, MADV_SEQUENTIAL);
+      return(true);
+    };
+
+    //! Read GEB records from memory owned by the caller, e.g. a decompressed block.
+    bool attach(const void* data, size_t n){
+      close();
+      base = static_cast<const unsigned char*>(data);
+      fSize = fEnd = n;
+      return(true);
+    };
+
+    //! Map again if the file has grown since open, the position is kept.
+    bool refresh(){
+      if(fd < 0) return(false);
+      struct stat st;
+      if(fstat(fd, &st) != 0) return(false);
+      size_t newSize = st.st_size;
+      if(newSize <= fSize) return(false);
+      void* m = mmap(0, newSize, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(m == MAP_FAILED) return(false);
+      if(fMapped) munmap(const_cast<unsigned char*>(base), fSize);
+      base = static_cast<const unsigned char*>(m);
+      fMapped = true;
+      if(fEnd == fSize) fEnd = newSize;
+      fSize = newSize;
+      madvise(m, fSize, MADV_SEQUENTIAL);
+      return(true);
+    };
+
+    void close(){
+      if(fMapped) munmap(const_cast<unsigned char*>(base), fSize);
+      if(fd >= 0) ::close(fd);
+      fd = -1; base = 0; fSize = 0; fEnd = 0; pos = 0; fMapped = false;
+    };
+
+    bool is_open() const { return fd >= 0 || base != 0; }
+    bool eof()     const { return pos >= fEnd; }
+    bool good()    const { return is_open() && !eof(); }
+
+    size_t size() const { return fSize; }
+    size_t tell() const { return pos; }
+    bool   seek(size_t off){ if(off > fEnd) return(false); pos = off; return(true); }
+
+    //! Restrict reading to [0,end), e.g. the GEB records in front of an index.
+    void   setEnd(size_t end){ fEnd = end < fSize ? end : fSize; }
+    size_t getEnd() const { return fEnd; }
+
+    //! Pointer to n bytes at the current position, 0 if the data is shorter.
+    const unsigned char* peek(size_t n) const { return (fEnd - pos >= n) ? base + pos : 0; }
+    const unsigned char* data() const { return base; }
+
+    bool readWord(uint64_t& w){
+      const unsigned char* p = peek(8);
+      if(!p) return(false);
+      w = load64(p); pos += 8;
+      return(true);
+    };
+
+    bool nextVFAT(VFATRecord& r){
+      const unsigned char* p = peek(kVFATSize);
+      if(!p) return(false);
+      r.p = p; pos += kVFATSize;
+      return(true);
+    };
+
+    //! Decode one frame into any struct with the GEMOnline::VFATData field names.
+    template <class VFAT>
+    bool readVFAT(VFAT& vfat){
+      VFATRecord r;
+      if(!nextVFAT(r)) return(false);
+      vfat.BC     = r.BC();
+      vfat.EC     = r.EC();
+      vfat.ChipID = r.ChipID();
+      vfat.lsData = r.lsData();
+      vfat.msData = r.msData();
+      vfat.crc    = r.crc();
+      return(true);
+    };
+
+    //! Number of VFAT2 frames which still fit in the file.
+    size_t remainingVFATs() const { return (fEnd - pos) / kVFATSize; }
+
+    // unaligned loads, compiled to plain moves
+    static uint16_t load16(const unsigned char* p){ uint16_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+    static uint32_t load32(const unsigned char* p){ uint32_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+    static uint64_t load64(const unsigned char* p){ uint64_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+
+  private:
+    GEMBinaryReader(const GEMBinaryReader&);
+    GEMBinaryReader& operator=(const GEMBinaryReader&);
+
+    int                  fd;
+    const unsigned char* base;
+    size_t               fSize;     // mapped bytes
+    size_t               fEnd;      // end of the readable data
+    size_t               pos;
+    bool                 fMapped;   // base is our mapping, not attached memory
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef GEM_BitFields
+#define GEM_BitFields
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMBitField, GEMBits                                                 //
+//                                                                      //
+// Bit layout of the AMC, GEB and VFAT2 words, one definition for the   //
+// decoders and the encoders                                            //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+//! Field of Width bits at bit Shift of a Word.
+/*!
+  \brief GEMBitField
+  everything is constexpr, get() is one shift and one and, set() and make()
+  one shift, and, or.
+
+    uint64_t ChamID = GEMBits::GEBHeader::ChamID::get(geb.header);
+    geb.header = GEMBits::GEBHeader::ZSFlag::make(ZSFlag) | GEMBits::GEBHeader::ChamID::make(ChamID) | ...
+ */
+
+template <class Word, unsigned Shift, unsigned Width>
+struct GEMBitField {
+  static_assert(Width > 0 && Shift + Width <= 8*sizeof(Word), "GEMBitField outside of its word");
+
+  typedef Word word_type;
+  static constexpr unsigned shift = Shift;
+  static constexpr unsigned width = Width;
+  //! Width low bits set.
+  static constexpr Word low  = (Width == 8*sizeof(Word)) ? Word(~Word(0)) : Word((Word(1) << (Width % (8*sizeof(Word)))) - 1);
+  //! The field bits in place.
+  static constexpr Word mask = Word(low << Shift);
+
+  static constexpr Word get(Word w){ return Word((w >> Shift) & low); }
+  //! v in place, bits of v above Width are dropped.
+  static constexpr Word make(Word v){ return Word((v & low) << Shift); }
+  static constexpr Word set(Word w, Word v){ return Word((w & ~mask) | make(v)); }
+  static constexpr bool fits(Word v){ return (v & ~low) == 0; }
+};
+
+template <class Word, unsigned Shift, unsigned Width> constexpr Word GEMBitField<Word, Shift, Width>::low;
+template <class Word, unsigned Shift, unsigned Width> constexpr Word GEMBitField<Word, Shift, Width>::mask;
+
+//! Word layouts, most significant field first as in the GEMOnline::GEMData comments.
+namespace GEMBits {
+
+  // AMC header 1: AmcNo:4 0000:4 LV1ID:24 BXID:12 DataLgth:20
+  namespace AMCHeader1 {
+    typedef GEMBitField<uint64_t, 60,  4> AmcNo;
+    typedef GEMBitField<uint64_t, 56,  4> Zero;
+    typedef GEMBitField<uint64_t, 32, 24> LV1ID;
+    typedef GEMBitField<uint64_t, 20, 12> BXID;
+    typedef GEMBitField<uint64_t,  0, 20> DataLgth;
+  }
+
+  // AMC header 2: User:32 OrN:16 BoardID:16
+  namespace AMCHeader2 {
+    typedef GEMBitField<uint64_t, 32, 32> User;
+    typedef GEMBitField<uint64_t, 16, 16> OrN;
+    typedef GEMBitField<uint64_t,  0, 16> BoardID;
+  }
+
+  // AMC header 3: DAVList:24 BufStat:24 DAVCount:5 FormatVer:3 MP7BordStat:8
+  namespace AMCHeader3 {
+    typedef GEMBitField<uint64_t, 40, 24> DAVList;
+    typedef GEMBitField<uint64_t, 16, 24> BufStat;
+    typedef GEMBitField<uint64_t, 11,  5> DAVCount;
+    typedef GEMBitField<uint64_t,  8,  3> FormatVer;
+    typedef GEMBitField<uint64_t,  0,  8> MP7BordStat;
+  }
+
+  // AMC trailer 2: EventStat:32 GEBerrFlag:24, the low 8 bits are not used
+  namespace AMCTrailer2 {
+    typedef GEMBitField<uint64_t, 32, 32> EventStat;
+    typedef GEMBitField<uint64_t,  8, 24> GEBerrFlag;
+  }
+
+  // AMC trailer 1: crc:32 LV1IDT:8 0000:4 DataLgth:20
+  namespace AMCTrailer1 {
+    typedef GEMBitField<uint64_t, 32, 32> crc;
+    typedef GEMBitField<uint64_t, 24,  8> LV1IDT;
+    typedef GEMBitField<uint64_t, 20,  4> Zero;
+    typedef GEMBitField<uint64_t,  0, 20> DataLgth;
+  }
+
+  // GEB header: ZSFlag:24 ChamID:12 sumVFAT:28
+  namespace GEBHeader {
+    typedef GEMBitField<uint64_t, 40, 24> ZSFlag;
+    typedef GEMBitField<uint64_t, 28, 12> ChamID;
+    typedef GEMBitField<uint64_t,  0, 28> SumVFAT;
+  }
+
+  // GEB trailer: OHcrc:16 OHwCount:16 ChamStatus:16, the low 16 bits are zero
+  namespace GEBTrailer {
+    typedef GEMBitField<uint64_t, 48, 16> OHcrc;
+    typedef GEMBitField<uint64_t, 32, 16> OHwCount;
+    typedef GEMBitField<uint64_t, 16, 16> ChamStatus;
+    typedef GEMBitField<uint64_t,  0, 16> Zero;
+  }
+
+  // VFAT2 words
+  namespace VFAT {
+    typedef GEMBitField<uint16_t, 12,  4> Control;   // 1010 of BC, 1100 of EC, 1110 of ChipID
+    typedef GEMBitField<uint16_t,  0, 12> BC;        // BC word:     1010:4 BC:12
+    typedef GEMBitField<uint16_t,  4,  8> EC;        // EC word:     1100:4 EC:8 Flag:4
+    typedef GEMBitField<uint16_t,  0,  4> Flag;
+    typedef GEMBitField<uint16_t,  0, 12> ChipID;    // ChipID word: 1110:4 ChipID:12
+    typedef GEMBitField<uint16_t,  8,  8> BxNum;     // bxNum word:  bxNum:8 SBit:8
+    typedef GEMBitField<uint16_t,  0,  8> SBit;
+
+    static const uint16_t k1010 = 0xa;
+    static const uint16_t k1100 = 0xc;
+    static const uint16_t k1110 = 0xe;
+  }
+
+}
+
+#endif
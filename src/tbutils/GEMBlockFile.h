@@ -0,0 +1,237 @@
+#ifndef GEM_BlockFile
+#define GEM_BlockFile
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMBlockWriter, GEMBlockReader                                       //
+//                                                                      //
+// Block compressed GEB records, each block is compressed with R__zip   //
+// on its own and carries the sizes and a CRC-32 of its content         //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "RZip.h"
+
+#include "GEMBinaryReader.h"
+#include "GEMDataWriter.h"
+
+//! Block file layout, host byte order.
+/*!
+    "GEMBLK01"                        8 bytes file magic
+    block header, 24 bytes:
+      uint32_t magic                  "GBLK"
+      uint32_t compressed size        payload bytes following the header
+      uint32_t uncompressed size      equal to the compressed size for stored blocks
+      uint32_t number of GEB records
+      uint32_t CRC-32 of the uncompressed payload
+      uint32_t CRC-32 of the first 20 header bytes
+    payload                           GEB records in the GEMBinaryReader layout
+
+  GEB records never span two blocks, so every block can be decompressed and
+  decoded independently. A block with a bad header is skipped by searching
+  for the next block magic, a block with a bad content CRC is reported and
+  skipped by the reader.
+ */
+
+namespace GEMBlock {
+
+  static const char     kMagic[8]     = {'G','E','M','B','L','K','0','1'};
+  static const uint32_t kBlockMagic   = 0x4b4c4247;   // "GBLK"
+  static const size_t   kHeaderSize   = 24;
+  static const size_t   kDefaultBlock = 1 << 20;       // uncompressed, R__zip takes at most 0xffffff per call
+  static const int      kDefaultComp  = 404;           // 100*algorithm + level, LZ4 level 4
+
+  //! CRC-32 (IEEE 802.3), table driven
+  struct CRC32Table {
+    uint32_t v[256];
+    CRC32Table(){
+      for(uint32_t i = 0; i < 256; ++i){
+        uint32_t c = i;
+        for(int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320 ^ (c >> 1) : (c >> 1);
+        v[i] = c;
+      }
+    }
+  };
+
+  inline uint32_t crc32(const void* data, size_t n, uint32_t crc = 0){
+    static const CRC32Table table;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for(size_t i = 0; i < n; ++i) crc = table.v[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+  };
+
+  struct BlockInfo {
+    uint64_t offset;      /*!<file offset of the payload */
+    uint32_t csize;
+    uint32_t usize;
+    uint32_t nRecords;
+    uint32_t crc;
+  };
+
+}
+
+//! Block compressed GEB writer.
+/*!
+  \brief GEMBlockWriter
+  GEB records are written to stream() with the GEMOnline::write*Binary
+  helpers, call endRecord() after each GEB trailer. A block is compressed
+  and written once it holds blockSize bytes, and on close().
+ */
+
+class GEMBlockWriter {
+  public:
+    explicit GEMBlockWriter(size_t blockSize_ = GEMBlock::kDefaultBlock, int compression_ = GEMBlock::kDefaultComp) :
+      blockSize(blockSize_), compression(compression_), nRecords(0) {}
+    ~GEMBlockWriter(){ close(); }
+
+    bool open(const std::string& file){
+      nRecords = 0;
+      if(!out.open(file, false)) return(false);
+      block.openMemory();
+      return(out.write(GEMBlock::kMagic, sizeof(GEMBlock::kMagic)));
+    };
+
+    //! R__zip compression settings, 100*algorithm + level
+    void setCompression(int settings){ compression = settings; }
+
+    bool is_open() const { return out.is_open(); }
+
+    GEMDataWriter& stream(){ return block; }
+
+    //! A complete GEB record has been written to stream().
+    bool endRecord(){
+      nRecords++;
+      if(block.bufferedSize() >= blockSize) return(flushBlock());
+      return(true);
+    };
+
+    bool close(){
+      if(!out.is_open()) return(true);
+      bool ok = flushBlock();
+      block.close();
+      return(out.close() && ok);
+    };
+
+  private:
+    bool flushBlock(){
+      if(block.bufferedSize() == 0) return(true);
+      char* src  = const_cast<char*>(block.buffered());
+      int usize  = block.bufferedSize();
+      int csize  = usize;
+      int irep   = 0;
+      cbuf.resize(usize + 512);
+      int tgt = cbuf.size();
+      R__zip(compression, &csize, src, &tgt, &cbuf[0], &irep);
+      const char* payload = &cbuf[0];
+      uint32_t plen = irep;
+      if(irep <= 0 || irep >= usize){ // not compressible, stored
+        payload = src;
+        plen = usize;
+      }
+      uint32_t header[6] = { GEMBlock::kBlockMagic, plen, (uint32_t)usize, nRecords,
+                             GEMBlock::crc32(src, usize), 0 };
+      header[5] = GEMBlock::crc32(header, 20);
+      out.write(header, sizeof(header));
+      out.write(payload, plen);
+      block.discard();
+      nRecords = 0;
+      return(!out.fail());
+    };
+
+    GEMDataWriter     out;
+    GEMDataWriter     block;
+    std::vector<char> cbuf;
+    size_t            blockSize;
+    int               compression;
+    uint32_t          nRecords;
+};
+
+//! Block compressed GEB reader.
+/*!
+  \brief GEMBlockReader
+  maps the file and lists the blocks on open(), decodeBlock() may be called
+  from several threads at once.
+ */
+
+class GEMBlockReader {
+  public:
+    GEMBlockReader() : skipped(0) {}
+
+    static bool isBlockFile(const std::string& file){
+      GEMBinaryReader r;
+      if(!r.open(file)) return(false);
+      const unsigned char* p = r.peek(sizeof(GEMBlock::kMagic));
+      return(p && std::memcmp(p, GEMBlock::kMagic, sizeof(GEMBlock::kMagic)) == 0);
+    };
+
+    bool open(const std::string& file){
+      blocks.clear(); skipped = 0;
+      if(!in.open(file)) return(false);
+      const unsigned char* base = in.data();
+      size_t size = in.size();
+      if(size < sizeof(GEMBlock::kMagic) || std::memcmp(base, GEMBlock::kMagic, sizeof(GEMBlock::kMagic)) != 0) return(false);
+      size_t pos = sizeof(GEMBlock::kMagic);
+      while(pos + GEMBlock::kHeaderSize <= size){
+        GEMBlock::BlockInfo b;
+        if(readHeader(base + pos, size - pos, b)){
+          b.offset = pos + GEMBlock::kHeaderSize;
+          blocks.push_back(b);
+          pos = b.offset + b.csize;
+          continue;
+        }
+        // damaged header: resynchronise on the next block magic
+        size_t next = pos + 1;
+        while(next + 4 <= size && GEMBinaryReader::load32(base + next) != GEMBlock::kBlockMagic) ++next;
+        if(next + 4 > size) next = size;
+        skipped += next - pos;
+        pos = next;
+      }
+      skipped += size - pos;
+      return(true);
+    };
+
+    void close(){ in.close(); blocks.clear(); skipped = 0; }
+
+    size_t   nBlocks()      const { return blocks.size(); }
+    uint64_t skippedBytes() const { return skipped; }
+    const GEMBlock::BlockInfo& block(size_t i) const { return blocks[i]; }
+
+    //! Uncompressed payload of block i, false if it does not inflate or the CRC does not match.
+    bool decodeBlock(size_t i, std::vector<unsigned char>& out) const {
+      const GEMBlock::BlockInfo& b = blocks[i];
+      const unsigned char* src = in.data() + b.offset;
+      out.resize(b.usize);
+      if(b.usize == 0) return(true);
+      if(b.csize == b.usize){
+        std::memcpy(&out[0], src, b.usize);
+      } else {
+        int csize = b.csize, usize = b.usize, irep = 0;
+        R__unzip(&csize, const_cast<unsigned char*>(src), &usize, &out[0], &irep);
+        if(irep != (int)b.usize) return(false);
+      }
+      return(GEMBlock::crc32(&out[0], b.usize) == b.crc);
+    };
+
+  private:
+    bool readHeader(const unsigned char* p, size_t avail, GEMBlock::BlockInfo& b) const {
+      uint32_t h[6];
+      std::memcpy(h, p, sizeof(h));
+      if(h[0] != GEMBlock::kBlockMagic) return(false);
+      if(GEMBlock::crc32(h, 20) != h[5]) return(false);
+      if(h[1] > avail - GEMBlock::kHeaderSize) return(false);
+      b.csize = h[1]; b.usize = h[2]; b.nRecords = h[3]; b.crc = h[4];
+      return(true);
+    };
+
+    GEMBinaryReader                  in;
+    std::vector<GEMBlock::BlockInfo> blocks;
+    uint64_t                         skipped;
+};
+
+#endif
@@ -0,0 +1,279 @@
+#ifndef GEM_ChipHistograms
+#define GEM_ChipHistograms
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMChipHistograms                                                    //
+//                                                                      //
+// DQM histograms of every VFAT2 chip, keyed by (ChamID, ChipID),       //
+// counted in integers and booked as TH1F only when written             //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <vector>
+#include <stdint.h>
+
+#include <TDirectory.h>
+#include <TH1.h>
+
+#include "GEMOccupancy.h"
+
+//! Per-chip Flag, CRC, control bit and channel occupancy counts.
+/*!
+  \brief GEMChipHistograms
+  A chip gets its counts on its first frame, about 1.5 kB, so the memory
+  follows the chips actually read. The (ChamID, ChipID) key is looked up
+  in a flat open-addressing table of at most half load, one multiply and
+  usually one probe per frame. The channel occupancy of the chips of a
+  chamber is kept in one GEMOccupancy, with its 16 kB ChipID table,
+  created with the first chip of the chamber.
+
+  write() books the TH1F of one chip at a time into Chips/ChamID_<id>/,
+  writes and deletes them:
+
+    Ch128_0x<chip>   frames with channel chan not fired, bin chan+1, as the global Ch128
+    Flag_0x<chip>    Flag:4
+    CRC_0x<chip>     CRC:16 in 64 bins
+
+  and once per chamber, bin ChipID+1 as the global CRCErr:
+
+    CRCErr           frames with a CRC error per ChipID
+    ControlErr       frames with wrong 1010, 1100 or 1110 control bits per ChipID
+
+  The not fired fraction of Ch128 replaces the 128 per-channel histograms
+  of the global set, which would be 128 TH1F for every chip.
+
+    GEMChipHistograms chips;
+    chips.add(ChamID, ChipID, Flag, CRC, vfat.crcOK, controlOK, vfat.lsData, vfat.msData);
+    chips.write(hfile->mkdir("Chips"));
+ */
+
+class GEMChipHistograms {
+  public:
+    static const int kCRCBins  = 64;
+    static const int kCRCShift = 10;      // CRC:16 >> 10, 64 bins
+
+    //! Integer counts of one chip.
+    struct ChipSet {
+      uint16_t chamID;
+      uint16_t chipID;
+      uint64_t frames;
+      uint64_t crcErrors;
+      uint64_t controlErrors;             // 1010, 1100 or 1110 control bits wrong
+      uint32_t flag[16];
+      uint32_t crc[kCRCBins];
+      GEMOccupancy* occupancy;            // of the chamber, the chip's channel counts
+    };
+
+    GEMChipHistograms() : table(kMinTable), nFrames(0) {}
+    GEMChipHistograms(const GEMChipHistograms& other) :
+      table(other.table), sets(other.sets), chamberIDs(other.chamberIDs), chambers(other.chambers), nFrames(other.nFrames) { rebind(); }
+
+    GEMChipHistograms& operator=(const GEMChipHistograms& other){
+      table      = other.table;
+      sets       = other.sets;
+      chamberIDs = other.chamberIDs;
+      chambers   = other.chambers;
+      nFrames    = other.nFrames;
+      rebind();
+      return *this;
+    };
+
+    static uint32_t key(const unsigned chamID, const unsigned chipID){ return ((chamID & 0xfff) << 12) | (chipID & 0xfff); }
+
+    //! The counts of chip (chamID, chipID), created empty on its first use.
+    ChipSet& get(const unsigned chamID, const unsigned chipID){
+      const uint32_t k = key(chamID, chipID);
+      size_t mask = table.size() - 1;
+      for(size_t i = hash(k) & mask; ; i = (i + 1) & mask){
+        Slot& s = table[i];
+        if(s.index < 0) return insert(i, k);
+        if(s.key == k) return sets[s.index];
+      }
+    };
+
+    //! One frame of chip (chamID, chipID).
+    void add(const unsigned chamID, const unsigned chipID, const uint8_t Flag, const uint16_t CRC, const bool crcOK, const bool controlOK,
+             const uint64_t lsData, const uint64_t msData){
+      ChipSet& chip = get(chamID, chipID);
+      chip.frames++;
+      if(!crcOK)     chip.crcErrors++;
+      if(!controlOK) chip.controlErrors++;
+      chip.flag[Flag & 0xf]++;
+      chip.crc[CRC >> kCRCShift]++;
+      chip.occupancy->add(chip.chipID, lsData, msData);
+      nFrames++;
+    };
+
+    size_t size() const { return sets.size(); }
+    uint64_t frames() const { return nFrames; }
+
+    //! Move the pending occupancy counts into the totals, before total() and chip occupancy->count().
+    void flush(){
+      for(size_t i = 0; i < chambers.size(); ++i) chambers[i].flush();
+    };
+
+    //! Frames of any chip with channel chan fired, after flush().
+    uint64_t total(const int chan) const {
+      uint64_t n = 0;
+      for(size_t i = 0; i < chambers.size(); ++i) n += chambers[i].total(chan);
+      return n;
+    };
+
+    //! Add the counts of other, chip by chip, e.g. of another decoding thread. Flushes other.
+    void merge(GEMChipHistograms& other){
+      for(size_t i = 0; i < other.sets.size(); ++i){
+        ChipSet& o = other.sets[i];
+        ChipSet& c = get(o.chamID, o.chipID);
+        c.frames        += o.frames;
+        c.crcErrors     += o.crcErrors;
+        c.controlErrors += o.controlErrors;
+        for(int b = 0; b < 16; ++b)       c.flag[b] += o.flag[b];
+        for(int b = 0; b < kCRCBins; ++b) c.crc[b]  += o.crc[b];
+      }
+      for(size_t i = 0; i < other.chambers.size(); ++i) chamber(other.chamberIDs[i]).merge(other.chambers[i]);
+      nFrames += other.nFrames;
+    };
+
+    //! The chips seen, by ChamID then ChipID.
+    std::vector<const ChipSet*> chips() const {
+      std::vector<const ChipSet*> v;
+      for(size_t i = 0; i < sets.size(); ++i) v.push_back(&sets[i]);
+      std::sort(v.begin(), v.end(), byKey);
+      return v;
+    };
+
+    //! Book, write and delete the histograms of every chip, one directory per chamber.
+    void write(TDirectory* dir){
+      flush();
+      std::vector<const ChipSet*> v = chips();
+      TDirectory* chamber = 0;
+      TH1F* crcErr = 0;
+      TH1F* controlErr = 0;
+      uint64_t nCRCErr = 0, nControlErr = 0;
+      char name[64], title[96];
+      for(size_t i = 0; i < v.size(); ++i){
+        const ChipSet& c = *v[i];
+        if(i == 0 || c.chamID != v[i-1]->chamID){
+          snprintf(name, sizeof(name), "ChamID_%u", c.chamID);
+          chamber = dir->mkdir(name);
+          snprintf(title, sizeof(title), "ChamID %u CRC errors per ChipID", c.chamID);
+          crcErr = book("CRCErr", title, 0x1000, -0.5, 0xfff+0.5);
+          snprintf(title, sizeof(title), "ChamID %u control bit errors per ChipID", c.chamID);
+          controlErr = book("ControlErr", title, 0x1000, -0.5, 0xfff+0.5);
+          nCRCErr = nControlErr = 0;
+        }
+        crcErr->SetBinContent(c.chipID + 1, c.crcErrors);
+        controlErr->SetBinContent(c.chipID + 1, c.controlErrors);
+        nCRCErr     += c.crcErrors;
+        nControlErr += c.controlErrors;
+
+        snprintf(name, sizeof(name), "Ch128_0x%03x", c.chipID);
+        snprintf(title, sizeof(title), "ChamID %u ChipID 0x%03x not fired channels", c.chamID, c.chipID);
+        TH1F* h = book(name, title, GEMOccupancy::kChannels, 0., GEMOccupancy::kChannels);
+        uint64_t notFired = 0;
+        for(int chan = 0; chan < GEMOccupancy::kChannels; ++chan){
+          const uint64_t n = c.frames - c.occupancy->count(c.chipID, chan);
+          h->SetBinContent(chan + 1, n);
+          notFired += n;
+        }
+        save(chamber, h, notFired);
+
+        snprintf(name, sizeof(name), "Flag_0x%03x", c.chipID);
+        snprintf(title, sizeof(title), "ChamID %u ChipID 0x%03x Flag", c.chamID, c.chipID);
+        h = book(name, title, 16, -0.5, 15.5);
+        for(int b = 0; b < 16; ++b) h->SetBinContent(b + 1, c.flag[b]);
+        save(chamber, h, c.frames);
+
+        snprintf(name, sizeof(name), "CRC_0x%03x", c.chipID);
+        snprintf(title, sizeof(title), "ChamID %u ChipID 0x%03x CRC", c.chamID, c.chipID);
+        h = book(name, title, kCRCBins, 0., 0x10000);
+        for(int b = 0; b < kCRCBins; ++b) h->SetBinContent(b + 1, c.crc[b]);
+        save(chamber, h, c.frames);
+
+        // the last chip of the chamber
+        if(i + 1 == v.size() || v[i+1]->chamID != c.chamID){
+          save(chamber, crcErr, nCRCErr);
+          save(chamber, controlErr, nControlErr);
+        }
+      }
+    };
+
+  private:
+    static const size_t kMinTable = 64;
+
+    struct Slot {
+      Slot() : key(0), index(-1) {}
+      uint32_t key;
+      int32_t  index;                     // into sets, -1 empty
+    };
+
+    static size_t hash(const uint32_t k){ return (k * 0x9e3779b1u) >> 8; }
+
+    static bool byKey(const ChipSet* a, const ChipSet* b){ return key(a->chamID, a->chipID) < key(b->chamID, b->chipID); }
+
+    ChipSet& insert(size_t i, const uint32_t k){
+      sets.push_back(ChipSet());
+      ChipSet& c = sets.back();
+      c.chamID = k >> 12;
+      c.chipID = k & 0xfff;
+      c.frames = c.crcErrors = c.controlErrors = 0;
+      std::fill(c.flag, c.flag + 16, 0);
+      std::fill(c.crc, c.crc + kCRCBins, 0);
+      c.occupancy = &chamber(c.chamID);
+      table[i].key   = k;
+      table[i].index = sets.size() - 1;
+      if(2*sets.size() > table.size()) grow();
+      return c;
+    };
+
+    //! Twice the slots, every key placed again.
+    void grow(){
+      std::vector<Slot> old(2*table.size());
+      old.swap(table);
+      size_t mask = table.size() - 1;
+      for(size_t j = 0; j < old.size(); ++j){
+        if(old[j].index < 0) continue;
+        size_t i = hash(old[j].key) & mask;
+        while(table[i].index >= 0) i = (i + 1) & mask;
+        table[i] = old[j];
+      }
+    };
+
+    //! Point the copied chips at the copied chambers.
+    void rebind(){
+      for(size_t i = 0; i < sets.size(); ++i) sets[i].occupancy = &chamber(sets[i].chamID);
+    };
+
+    //! The occupancy of chamber chamID, created empty on its first use.
+    GEMOccupancy& chamber(const uint16_t chamID){
+      for(size_t i = 0; i < chamberIDs.size(); ++i) if(chamberIDs[i] == chamID) return chambers[i];
+      chamberIDs.push_back(chamID);
+      chambers.push_back(GEMOccupancy());
+      return chambers.back();
+    };
+
+    static TH1F* book(const char* name, const char* title, int nBins, double xlow, double xup){
+      TH1F* h = new TH1F(name, title, nBins, xlow, xup);
+      h->SetDirectory(0);
+      h->SetFillColor(48);
+      return h;
+    };
+
+    static void save(TDirectory* dir, TH1F* h, const uint64_t entries){
+      h->SetEntries(entries);
+      dir->WriteTObject(h);
+      delete h;
+    };
+
+    std::vector<Slot>        table;       // size a power of two
+    std::deque<ChipSet>      sets;        // stable addresses, get() references stay valid
+    std::vector<uint16_t>    chamberIDs;  // ChamID of chambers[i]
+    std::deque<GEMOccupancy> chambers;    // stable addresses, ChipSet::occupancy stays valid
+    uint64_t                 nFrames;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef GEM_Crc16
+#define GEM_Crc16
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMCrc16                                                             //
+//                                                                      //
+// CRC-16 of the VFAT2 frames, checked against VFATData::crc            //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+//! VFAT2 CRC-16.
+/*!
+  \brief GEMCrc16
+  reflected polynomial 0x8408 (x^16+x^12+x^5+1), initial value 0xffff, no
+  final xor. The VFAT2 feeds eleven 16 bit words, each one LSB first:
+  BC, EC, ChipID, msData 63:48 ... 15:0, lsData 63:48 ... 15:0.
+  LSB first bit order makes every word its low byte followed by its high
+  byte, which is processed with slicing-by-8 tables (8 x 256 entries), one
+  lookup per byte and no dependency between the lookups of a 64 bit word.
+ */
+
+class GEMCrc16 {
+  public:
+    static const uint16_t kPoly = 0x8408;
+    static const uint16_t kInit = 0xffff;
+
+    //! Bit by bit, one 16 bit word, as the VFAT2 hardware.
+    static uint16_t bitwise(uint16_t crc, uint16_t word){
+      for(int i = 0; i < 16; ++i){
+        bool d = (word >> i) & 1;
+        crc = ((crc & 1) ^ d) ? (crc >> 1) ^ kPoly : (crc >> 1);
+      }
+      return crc;
+    };
+
+    //! CRC-16 of one VFAT2 frame.
+    static uint16_t vfat2(uint16_t BC, uint16_t EC, uint16_t ChipID, uint64_t lsData, uint64_t msData){
+      const Tables& t = tables();
+      uint16_t crc = kInit;
+      // BC, EC, ChipID: 6 bytes
+      uint64_t v = (uint64_t(BC) | (uint64_t(EC) << 16) | (uint64_t(ChipID) << 32)) ^ crc;
+      crc = t.v[5][v & 0xff]         ^ t.v[4][(v >> 8) & 0xff]  ^ t.v[3][(v >> 16) & 0xff] ^
+            t.v[2][(v >> 24) & 0xff] ^ t.v[1][(v >> 32) & 0xff] ^ t.v[0][(v >> 40) & 0xff];
+      crc = slice8(t, crc, swapWords(msData));
+      crc = slice8(t, crc, swapWords(lsData));
+      return crc;
+    };
+
+    //! Any struct with the GEMOnline::VFATData field names.
+    template <class VFAT>
+    static bool check(const VFAT& vfat){ return(vfat2(vfat.BC, vfat.EC, vfat.ChipID, vfat.lsData, vfat.msData) == vfat.crc); }
+
+  private:
+    //! v[k][b]: CRC contribution of byte b followed by k zero bytes.
+    struct Tables {
+      uint16_t v[8][256];
+      Tables(){
+        for(int b = 0; b < 256; ++b){
+          uint16_t c = b;
+          for(int i = 0; i < 8; ++i) c = (c & 1) ? (c >> 1) ^ kPoly : (c >> 1);
+          v[0][b] = c;
+        }
+        for(int k = 1; k < 8; ++k)
+          for(int b = 0; b < 256; ++b) v[k][b] = (v[k-1][b] >> 8) ^ v[0][v[k-1][b] & 0xff];
+      }
+    };
+    static const Tables& tables(){ static const Tables t; return t; }
+
+    //! 16 bit words in reverse order, the most significant word is fed first.
+    static uint64_t swapWords(uint64_t x){
+      x = (x >> 32) | (x << 32);
+      return ((x >> 16) & 0x0000ffff0000ffffULL) | ((x & 0x0000ffff0000ffffULL) << 16);
+    };
+
+    //! 8 bytes, the low byte of v first.
+    static uint16_t slice8(const Tables& t, uint16_t crc, uint64_t v){
+      v ^= crc;
+      return t.v[7][v & 0xff]         ^ t.v[6][(v >> 8) & 0xff]  ^ t.v[5][(v >> 16) & 0xff] ^ t.v[4][(v >> 24) & 0xff] ^
+             t.v[3][(v >> 32) & 0xff] ^ t.v[2][(v >> 40) & 0xff] ^ t.v[1][(v >> 48) & 0xff] ^ t.v[0][(v >> 56)];
+    };
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef GEM_DQMCounts
+#define GEM_DQMCounts
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMFixedBins, GEMDQMCounts                                           //
+//                                                                      //
+// Integer counts behind the gem-reading DQM histograms, one set per    //
+// decoded chunk of several inputs, see GEMMultiFileInput               //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <stdint.h>
+
+#include <TH1.h>
+
+#include "GEMBitFields.h"
+#include "GEMChipHistograms.h"
+
+//! Fixed bin TH1 counted in integers.
+/*!
+  \brief GEMFixedBins
+  The bins of TH1(nBins, xlow, xup), 0 underflow and nBins+1 overflow as
+  TAxis::FindFixBin. fill() sets a histogram of the same binning.
+ */
+
+class GEMFixedBins {
+  public:
+    GEMFixedBins(const int nBins_, const double xlow_, const double xup_) :
+      nBins(nBins_), xlow(xlow_), xup(xup_), bins(nBins_ + 2, 0), entries(0) {}
+
+    int bin(const double x) const {
+      if(x < xlow) return 0;
+      if(!(x < xup)) return nBins + 1;
+      return 1 + int(nBins*(x - xlow)/(xup - xlow));
+    };
+
+    void add(const double x){ bins[bin(x)]++; entries++; }
+
+    void merge(const GEMFixedBins& other){
+      for(size_t b = 0; b < bins.size(); ++b) bins[b] += other.bins[b];
+      entries += other.entries;
+    };
+
+    uint64_t content(const int b) const { return bins[b]; }
+
+    void fill(TH1* h) const {
+      for(int b = 0; b < nBins + 2; ++b) h->SetBinContent(b, bins[b]);
+      h->SetEntries(entries);
+    };
+
+  private:
+    int    nBins;
+    double xlow;
+    double xup;
+    std::vector<uint64_t> bins;
+    uint64_t entries;
+};
+
+//! The counts of the global and per-chip DQM histograms of gem-reading.
+/*!
+  \brief GEMDQMCounts
+  addGEB() takes a decoded GEB record (GEMOnline::GEBData of gem-reading:
+  header and vfats with BC, EC, ChipID, crc, crcOK, lsData, msData).
+  The binning is the one of the histograms booked in gem-reading.
+ */
+
+class GEMDQMCounts {
+  public:
+    GEMDQMCounts() :
+      vfat(100, -0.5, 300.5), b1010(100, 0x0, 0xf), b1100(100, 0x0, 0xf), b1110(100, 0x0, 0xf),
+      chip(100, 0x0, 0xfff), flag(100, 0x0, 0xf), crc(100, 0x0, 0xffff),
+      crcFrames(0x1000, 0), crcErrors(0x1000, 0) {}
+
+    template <class GEB>
+    void addGEB(const GEB& geb){
+      uint64_t ChamID  = GEMBits::GEBHeader::ChamID::get(geb.header);
+      for(size_t ivfat = 0; ivfat < geb.vfats.size(); ++ivfat){
+        const auto& v = geb.vfats[ivfat];
+        uint8_t  b1010_  = GEMBits::VFAT::Control::get(v.BC);
+        uint8_t  b1100_  = GEMBits::VFAT::Control::get(v.EC);
+        uint8_t  Flag    = GEMBits::VFAT::Flag::get(v.EC);
+        uint8_t  b1110_  = GEMBits::VFAT::Control::get(v.ChipID);
+        uint16_t ChipID  = GEMBits::VFAT::ChipID::get(v.ChipID);
+
+        vfat.add(ivfat);
+        b1010.add(b1010_);
+        b1100.add(b1100_);
+        flag.add(Flag);
+        b1110.add(b1110_);
+        if (ChipID != 0xdead) chip.add(ChipID);
+        crc.add(v.crc);
+        crcFrames[ChipID]++;
+        if(!v.crcOK) crcErrors[ChipID]++;
+
+        bool controlOK = b1010_ == GEMBits::VFAT::k1010 && b1100_ == GEMBits::VFAT::k1100 && b1110_ == GEMBits::VFAT::k1110;
+        chips.add(ChamID, ChipID, Flag, v.crc, v.crcOK, controlOK, v.lsData, v.msData);
+      }
+    };
+
+    void merge(GEMDQMCounts& other){
+      vfat.merge(other.vfat);
+      b1010.merge(other.b1010);
+      b1100.merge(other.b1100);
+      b1110.merge(other.b1110);
+      chip.merge(other.chip);
+      flag.merge(other.flag);
+      crc.merge(other.crc);
+      for(size_t i = 0; i < crcFrames.size(); ++i){ crcFrames[i] += other.crcFrames[i]; crcErrors[i] += other.crcErrors[i]; }
+      chips.merge(other.chips);
+    };
+
+    GEMFixedBins vfat;                  // VFAT2 frame number in its GEB
+    GEMFixedBins b1010;
+    GEMFixedBins b1100;
+    GEMFixedBins b1110;
+    GEMFixedBins chip;
+    GEMFixedBins flag;
+    GEMFixedBins crc;
+    std::vector<uint64_t> crcFrames;    // per ChipID:12
+    std::vector<uint64_t> crcErrors;
+    GEMChipHistograms     chips;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef GEM_DataWriter
+#define GEM_DataWriter
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMDataWriter                                                        //
+//                                                                      //
+// Buffered output sink for the GEB/VFAT text and binary streams        //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//! Buffered GEB data writer.
+/*!
+  \brief GEMDataWriter
+  keeps one file descriptor open for the whole conversion and collects the
+  output in a user space buffer, which is written out when it is full, on
+  flush() and on close().
+ */
+
+class GEMDataWriter {
+  public:
+    static const size_t kDefaultBuffer = 4 << 20;
+
+    explicit GEMDataWriter(size_t bufferSize = kDefaultBuffer) :
+      fd(-1), buf(bufferSize), used(0), written(0), fFail(false), fMemory(false) {}
+    ~GEMDataWriter(){ close(); }
+
+    //! Open for writing, appending to an existing file as the old ofstream(file, ios_base::app) did.
+    bool open(const std::string& file, bool append = true){
+      close();
+      fd = ::open(file.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+      fFail = (fd < 0);
+      return(!fFail);
+    };
+
+    //! Collect the output in memory only, the owner takes it with buffered() and discard().
+    void openMemory(){
+      close();
+      used = 0; written = 0; fFail = false;
+      fMemory = true;
+    };
+
+    bool close(){
+      bool ok = flush();
+      if(fd >= 0) ::close(fd);
+      fd = -1;
+      fMemory = false;
+      return(ok);
+    };
+
+    bool is_open() const { return fd >= 0 || fMemory; }
+    bool fail()    const { return fFail; }
+
+    //! Bytes handed to the writer since open, flushed or not.
+    uint64_t bytesWritten() const { return written + used; }
+
+    // memory mode
+    const char* buffered()     const { return &buf[0]; }
+    size_t      bufferedSize() const { return used; }
+    void        discard()            { written += used; used = 0; }
+
+    bool flush(){
+      if(fd < 0) return(!fFail);
+      const char* p = &buf[0];
+      size_t n = used;
+      while(n){
+        ssize_t w = ::write(fd, p, n);
+        if(w < 0){
+          if(errno == EINTR) continue;
+          fFail = true;
+          break;
+        }
+        p += w; n -= w;
+      }
+      written += used - n;
+      used = 0;
+      return(!fFail);
+    };
+
+    bool write(const void* data, size_t n){
+      if(fMemory){
+        if(used + n > buf.size()) buf.resize(2*(used + n));
+      } else if(fd < 0) return(false);
+      if(used + n > buf.size()){
+        if(!flush()) return(false);
+        if(n > buf.size()) return(writeDirect(data, n));
+      }
+      std::memcpy(&buf[0] + used, data, n);
+      used += n;
+      return(true);
+    };
+
+    //! Raw host order copy of a value, the binary format.
+    template <class T>
+    bool writeBinary(const T& v){ return(write(&v, sizeof(v))); };
+
+    //! Lower case hex without leading zeros and a new line, as "outf << hex << v << endl".
+    bool writeHex(uint64_t v){
+      char line[17];
+      char* p = line + 16;
+      *p = '\n';
+      do { *--p = "0123456789abcdef"[v & 0xf]; v >>= 4; } while(v);
+      return(write(p, line + 17 - p));
+    };
+
+  private:
+    GEMDataWriter(const GEMDataWriter&);
+    GEMDataWriter& operator=(const GEMDataWriter&);
+
+    bool writeDirect(const void* data, size_t n){
+      const char* p = static_cast<const char*>(data);
+      while(n){
+        ssize_t w = ::write(fd, p, n);
+        if(w < 0){
+          if(errno == EINTR) continue;
+          fFail = true;
+          return(false);
+        }
+        p += w; n -= w; written += w;
+      }
+      return(true);
+    };
+
+    int               fd;
+    std::vector<char> buf;
+    size_t            used;
+    uint64_t          written;
+    bool              fFail;
+    bool              fMemory;
+};
+
+#endif
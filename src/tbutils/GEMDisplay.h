@@ -0,0 +1,163 @@
+#ifndef GEM_Display
+#define GEM_Display
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMDisplay                                                           //
+//                                                                      //
+// Live DQM canvas drawn from double-buffered histogram snapshots, the  //
+// decoding thread only copies histograms at a wall-clock interval      //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <TCanvas.h>
+#include <TH1.h>
+#include <TSystem.h>
+
+//! Snapshot display of a canvas of histograms.
+/*!
+  \brief GEMDisplay
+  The decoding thread owns the source histograms. When due() it calls
+  publish(update): update() brings the sources up to date (e.g. from
+  counters), they are copied into the back buffer and the buffers are
+  swapped under a short lock, never waiting for the painting. The thread
+  of run(), the one with the TApplication, draws the front buffer on the
+  canvas and keeps the GUI responsive until finish() is called.
+
+    GEMDisplay display(c1, refreshMs);
+    display.add(1, hiVFAT, true);
+    std::thread decoder([&]{ decode(); display.finish(); });
+    display.run();
+    decoder.join();
+
+  With intervalMs 0 nothing is ever due and run() returns at finish().
+  ROOT must be thread safe, ROOT::EnableThreadSafety() on ROOT 6.
+ */
+
+class GEMDisplay {
+  public:
+    GEMDisplay(TCanvas* canvas_, const int intervalMs_) :
+      canvas(canvas_), intervalMs(intervalMs_), fresh(false), finished(false), nSnapshots(0),
+      last(std::chrono::steady_clock::now()) {}
+
+    ~GEMDisplay(){
+      for(size_t i = 0; i < pads.size(); ++i){ delete pads[i].front; delete pads[i].back; }
+    };
+
+    //! Draw source on pad, logarithmic y if logy. Before the decoding starts.
+    void add(const int pad, TH1* source, const bool logy = false){
+      Pad p;
+      p.pad    = pad;
+      p.logy   = logy;
+      p.source = source;
+      p.front  = clone(source, "_front");
+      p.back   = clone(source, "_back");
+      pads.push_back(p);
+    };
+
+    bool enabled() const { return intervalMs > 0; }
+
+    //! Decoding thread: the interval since the last snapshot has passed.
+    bool due() const {
+      if(!enabled()) return(false);
+      return std::chrono::steady_clock::now() - last >= std::chrono::milliseconds(intervalMs);
+    };
+
+    //! Decoding thread: update the sources, copy their contents into the back buffer and hand it over.
+    void publish(const std::function<void()>& update){
+      if(!enabled()) return;
+      update();
+      std::lock_guard<std::mutex> lock(mtx);
+      // contents only, TH1::Copy would also take the name and directory of the source
+      for(size_t i = 0; i < pads.size(); ++i){
+        pads[i].back->Reset();
+        pads[i].back->Add(pads[i].source);
+      }
+      fresh = true;
+      nSnapshots++;
+      last = std::chrono::steady_clock::now();
+      cv.notify_one();
+    };
+
+    //! Decoding thread: no more snapshots, run() returns.
+    void finish(){
+      std::lock_guard<std::mutex> lock(mtx);
+      finished = true;
+      cv.notify_one();
+    };
+
+    //! GUI thread: draw every new snapshot, process GUI events, until finish().
+    void run(){
+      const int pollMs = enabled() ? std::min(intervalMs, 100) : 100;
+      for(;;){
+        bool draw = false, done = false;
+        {
+          std::unique_lock<std::mutex> lock(mtx);
+          cv.wait_for(lock, std::chrono::milliseconds(pollMs), [this]{ return fresh || finished; });
+          if(fresh){
+            // the pads leave the old front before publish() may write into it, painting is left to Update()
+            for(size_t i = 0; i < pads.size(); ++i) std::swap(pads[i].front, pads[i].back);
+            drawPads(false);
+            fresh = false;
+            draw  = true;
+          }
+          done = finished;
+        }
+        if(draw) canvas->Update();
+        gSystem->ProcessEvents();
+        if(done) return;
+      }
+    };
+
+    //! GUI thread, decoding finished: draw the sources themselves.
+    void drawFinal(){
+      drawPads(true);
+      canvas->Update();
+    };
+
+    uint64_t snapshots() const { return nSnapshots; }
+
+  private:
+    struct Pad {
+      int  pad;
+      bool logy;
+      TH1* source;
+      TH1* front;       // drawn
+      TH1* back;        // filled by publish()
+    };
+
+    static TH1* clone(TH1* source, const char* suffix){
+      TH1* h = (TH1*)source->Clone((std::string(source->GetName()) + suffix).c_str());
+      h->SetDirectory(0);
+      return h;
+    };
+
+    //! The front histograms are other objects after every swap, the pads are drawn again.
+    void drawPads(const bool sources){
+      for(size_t i = 0; i < pads.size(); ++i){
+        canvas->cd(pads[i].pad)->SetLogy(pads[i].logy);
+        (sources ? pads[i].source : pads[i].front)->Draw();
+      }
+    };
+
+    TCanvas*                 canvas;
+    int                      intervalMs;
+    std::vector<Pad>         pads;
+    bool                     fresh;       // back holds a snapshot not drawn yet
+    bool                     finished;
+    std::atomic<uint64_t>    nSnapshots;
+    std::chrono::steady_clock::time_point last;
+    std::mutex               mtx;
+    std::condition_variable  cv;
+};
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef GEM_EventLookup
+#define GEM_EventLookup
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMChamberIndex, GEMEventLookup                                      //
+//                                                                      //
+// Point queries on GEMtree: the TTreeIndex on (LV1ID, BXID) and one    //
+// TEntryList of GEMtree entries per ChamID, both in DQMlight.root      //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include <RVersion.h>
+#include <TDirectory.h>
+#include <TEntryList.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TTreeIndex.h>
+
+#include "Event.h"
+
+//! Per-ChamID entry lists of GEMtree, filled while the tree is written.
+/*!
+  \brief GEMChamberIndex
+  enter() once per GEB with the number of the GEMtree entry being filled,
+  write() stores the lists as GEMindex/ChamID_<id> and builds the tree index.
+ */
+
+class GEMChamberIndex {
+  public:
+    static const char* directory(){ return "GEMindex"; }
+    static void listName(char* name, size_t size, const unsigned chamID){ snprintf(name, size, "ChamID_%u", chamID); }
+
+    GEMChamberIndex() {}
+    ~GEMChamberIndex(){
+      for(std::map<unsigned, TEntryList*>::iterator it = lists.begin(); it != lists.end(); ++it) delete it->second;
+    };
+
+    //! Entry entry of GEMtree has a GEB of chamber chamID, entering it twice is harmless.
+    void enter(const unsigned chamID, const Long64_t entry){
+      TEntryList*& list = lists[chamID];
+      if(!list){
+        char name[32];
+        listName(name, sizeof(name), chamID);
+        list = new TEntryList(name, "GEMtree entries with a GEB of this chamber");
+        list->SetDirectory(0);
+      }
+      list->Enter(entry);
+    };
+
+    size_t chambers() const { return lists.size(); }
+
+    //! The lists into file:GEMindex/, and the (LV1ID, BXID) index into tree when byLV1ID, before file->Write().
+    /*!
+      BuildIndex reads back the LV1ID and BXID branches only, with the
+      default split level they are branches of their own.
+     */
+    void write(TFile* file, TTree* tree, const bool byLV1ID) const {
+      if(byLV1ID && tree->GetEntries() > 0) tree->BuildIndex("GEMEvents.LV1ID", "GEMEvents.BXID");
+      if(lists.empty()) return;
+      TDirectory* dir = file->mkdir(directory());
+      for(std::map<unsigned, TEntryList*>::const_iterator it = lists.begin(); it != lists.end(); ++it) dir->WriteTObject(it->second);
+    };
+
+  private:
+    std::map<unsigned, TEntryList*> lists;
+};
+
+//! Reads only the GEMtree entries of an LV1ID, an (LV1ID, BXID) pair or a chamber.
+/*!
+  \brief GEMEventLookup
+
+    GEMEventLookup lookup(TFile::Open("DQMlight.root"));
+    std::vector<Long64_t> entries = lookup.findChamber(0x5a3);
+    for(size_t i = 0; i < entries.size(); ++i){
+      lookup.read(entries[i]);
+      use(*lookup.event());
+    }
+
+  find() is a binary search in the TTreeIndex, findChamber() reads one
+  TEntryList, read() decompresses the baskets of that entry only.
+ */
+
+class GEMEventLookup {
+  public:
+    GEMEventLookup(TFile* file_, const char* treeName = "GEMtree", const char* branchName = "GEMEvents") :
+      file(file_), tree(0), ev(0)
+    {
+      if(!file || file->IsZombie()) return;
+      file->GetObject(treeName, tree);
+      if(tree) tree->SetBranchAddress(branchName, &ev);
+    };
+
+    bool good() const { return tree != 0; }
+    bool indexed() const { return tree && tree->GetTreeIndex(); }
+    TTree* getTree() const { return tree; }
+    //! The entry of the last read().
+    Event* event() const { return ev; }
+
+    //! Entry with this LV1ID and BXID, -1 if there is none or no index.
+    Long64_t find(const Int_t lv1id, const Int_t bxid) const {
+      if(!indexed()) return(-1);
+      return tree->GetEntryNumberWithIndex(lv1id, bxid);
+    };
+
+    //! Entries with this LV1ID, any BXID, in increasing BXID.
+    std::vector<Long64_t> findLV1ID(const Int_t lv1id) const {
+      std::vector<Long64_t> entries;
+      TTreeIndex* index = indexed() ? dynamic_cast<TTreeIndex*>(tree->GetTreeIndex()) : 0;
+      if(!index || index->GetN() == 0) return entries;
+      // TTreeIndex sorts by (major, minor), the entries of one major are contiguous
+      const Long64_t* values = index->GetIndexValues();
+      const Long64_t* end    = values + index->GetN();
+#if ROOT_VERSION_CODE < ROOT_VERSION(6,0,0)
+      // ROOT 5 keeps major<<31 + minor
+      const Long64_t* first  = std::lower_bound(values, end, Long64_t(lv1id) << 31);
+      const Long64_t* last   = std::lower_bound(first, end, Long64_t(lv1id + 1) << 31);
+#else
+      // ROOT 6 keeps the majors here and the minors in GetIndexValuesMinor()
+      const Long64_t* first  = std::lower_bound(values, end, Long64_t(lv1id));
+      const Long64_t* last   = std::upper_bound(first, end, Long64_t(lv1id));
+#endif
+      for(const Long64_t* v = first; v != last; ++v) entries.push_back(index->GetIndex()[v - values]);
+      return entries;
+    };
+
+    //! Entries with a GEB of chamber chamID, increasing, empty if the chamber is not in the file.
+    std::vector<Long64_t> findChamber(const unsigned chamID) const {
+      std::vector<Long64_t> entries;
+      if(!good()) return entries;
+      char name[64];
+      GEMChamberIndex::listName(name, sizeof(name), chamID);
+      TDirectory* dir = file->GetDirectory(GEMChamberIndex::directory());
+      TEntryList* list = 0;
+      if(dir) dir->GetObject(name, list);
+      if(!list) return entries;
+      Long64_t n = list->GetN();
+      entries.reserve(n);
+      for(Long64_t i = 0; i < n; ++i) entries.push_back(i == 0 ? list->GetEntry(0) : list->Next());
+      delete list;
+      return entries;
+    };
+
+    //! Read entry into event(), false for -1 or a read error.
+    bool read(const Long64_t entry){
+      if(!good() || entry < 0) return(false);
+      return(tree->GetEntry(entry) > 0);
+    };
+
+  private:
+    TFile*  file;
+    TTree*  tree;
+    Event*  ev;
+};
+
+#endif
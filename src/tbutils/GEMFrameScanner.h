@@ -0,0 +1,197 @@
+#ifndef GEM_FrameScanner
+#define GEM_FrameScanner
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMFrameScanner                                                      //
+//                                                                      //
+// Checks the framing of binary GEB records (VFAT2 control nibbles and  //
+// trailer position) and finds the next valid record after damage       //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <cstring>
+
+#include "GEMBinaryReader.h"
+#include "GEMBitFields.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEM_FRAMESCANNER_X86 1
+#endif
+
+//! GEB record framing check.
+/*!
+  \brief GEMFrameScanner
+  a VFAT2 frame is valid when BC, EC and ChipID carry their control nibbles
+  1010, 1100 and 1110, a GEB record is valid when all sumVFAT frames are valid
+  and the word right after them is a trailer (ChamStatus << 16, the low 16
+  bits are zero, so a trailer never looks like a frame). The nibbles of many
+  frames are compared at once with SSE2/AVX2, the frame stride of 24 bytes
+  repeats every 48/96 bytes, so a few constant masks cover all positions.
+  The vector code assumes the little endian byte order of x86.
+
+  Records without VFAT2 frames are not found by resync().
+ */
+
+class GEMFrameScanner {
+  public:
+    enum Status { kGood, kIncomplete, kBad };
+
+    static bool validFrame(uint16_t BC, uint16_t EC, uint16_t ChipID){
+      return GEMBits::VFAT::Control::get(BC) == GEMBits::VFAT::k1010 && GEMBits::VFAT::Control::get(EC) == GEMBits::VFAT::k1100 &&
+             GEMBits::VFAT::Control::get(ChipID) == GEMBits::VFAT::k1110;
+    };
+    static bool validTrailer(uint64_t trailer){ return GEMBits::GEBTrailer::Zero::get(trailer) == 0; }
+
+    //! Number of leading valid frames among the n frames at p.
+    static size_t validFrames(const unsigned char* p, size_t n){
+      size_t i = 0;
+#ifdef GEM_FRAMESCANNER_X86
+      static const bool avx2 = __builtin_cpu_supports("avx2");
+      i = avx2 ? validFramesAVX2(p, n) : validFramesSSE2(p, n);
+#endif
+      for(; i < n; ++i){
+        const unsigned char* f = p + i*GEMBinaryReader::kVFATSize;
+        if(!validFrame(GEMBinaryReader::load16(f), GEMBinaryReader::load16(f + 2), GEMBinaryReader::load16(f + 4))) break;
+      }
+      return i;
+    };
+
+    //! Offset of the first valid frame which fits in [p,p+len), else the first offset where one may still be incomplete.
+    static size_t findFrame(const unsigned char* p, size_t len){
+      if(len < GEMBinaryReader::kVFATSize) return 0;
+      size_t last = len - GEMBinaryReader::kVFATSize;   // last complete frame start
+      size_t j = 0;
+#ifdef GEM_FRAMESCANNER_X86
+      static const bool avx2 = __builtin_cpu_supports("avx2");
+      j = avx2 ? findFrameAVX2(p, len) : findFrameSSE2(p, len);
+      if(j <= last && isFrame(p + j)) return j;
+#endif
+      for(; j <= last; ++j) if(isFrame(p + j)) return j;
+      return last + 1;
+    };
+
+    //! Check the record at p, its size on kGood.
+    static Status checkGEB(const unsigned char* p, size_t avail, size_t& size){
+      if(avail < GEMBinaryReader::kGEBheaderSize) return kIncomplete;
+      uint64_t sumVFAT = GEMBits::GEBHeader::SumVFAT::get(GEMBinaryReader::load64(p));
+      size_t fit = (avail - GEMBinaryReader::kGEBheaderSize)/GEMBinaryReader::kVFATSize;
+      size_t n   = sumVFAT < fit ? sumVFAT : fit;
+      if(validFrames(p + GEMBinaryReader::kGEBheaderSize, n) != n) return kBad;
+      size = GEMBinaryReader::kGEBheaderSize + sumVFAT*GEMBinaryReader::kVFATSize + GEMBinaryReader::kGEBtrailerSize;
+      if(sumVFAT > fit || size > avail) return kIncomplete;
+      if(!validTrailer(GEMBinaryReader::load64(p + size - GEMBinaryReader::kGEBtrailerSize))) return kBad;
+      return kGood;
+    };
+
+    //! Offset > 0 of the next record start which is not kBad, for the bytes at p starting a damaged record.
+    /*!
+      status and size are the checkGEB() of the record found, kIncomplete if it may still be growing.
+     */
+    static size_t resync(const unsigned char* p, size_t avail, Status& status, size_t& size){
+      const size_t h = GEMBinaryReader::kGEBheaderSize;
+      size_t from = 1;
+      status = kIncomplete;
+      for(;;){
+        if(from + h >= avail) return(from < avail ? from : avail);
+        size_t f = from + h + findFrame(p + from + h, avail - from - h);
+        size_t start = f - h;
+        if(f + GEMBinaryReader::kVFATSize > avail) return(start);    // may still become a record
+        status = checkGEB(p + start, avail - start, size);
+        if(status != kBad) return(start);
+        from = start + 1;
+      }
+    };
+
+  private:
+    static bool isFrame(const unsigned char* f){
+      return(validFrame(GEMBinaryReader::load16(f), GEMBinaryReader::load16(f + 2), GEMBinaryReader::load16(f + 4)));
+    };
+
+#ifdef GEM_FRAMESCANNER_X86
+    //! and-mask and expected value of every byte in 96 bytes = 4 frames, the high byte of BC/EC/ChipID is checked.
+    struct NibbleMasks {
+      unsigned char mask[96];
+      unsigned char want[96];
+      NibbleMasks(){
+        std::memset(mask, 0, sizeof(mask));
+        std::memset(want, 0, sizeof(want));
+        for(int f = 0; f < 4; ++f){
+          mask[24*f + 1] = mask[24*f + 3] = mask[24*f + 5] = 0xf0;
+          want[24*f + 1] = 0xa0; want[24*f + 3] = 0xc0; want[24*f + 5] = 0xe0;
+        }
+      }
+    };
+    static const NibbleMasks& nibbleMasks(){ static const NibbleMasks m; return m; }
+
+    //! Valid leading frames, whole groups of 2 frames only, the caller checks the rest.
+    static size_t validFramesSSE2(const unsigned char* p, size_t n){
+      const NibbleMasks& m = nibbleMasks();
+      size_t i = 0;
+      for(; i + 2 <= n; i += 2, p += 48){
+        for(int k = 0; k < 3; ++k){
+          __m128i v = _mm_loadu_si128((const __m128i*)(p + 16*k));
+          __m128i c = _mm_cmpeq_epi8(_mm_and_si128(v, _mm_loadu_si128((const __m128i*)(m.mask + 16*k))),
+                                     _mm_loadu_si128((const __m128i*)(m.want + 16*k)));
+          unsigned bad = ~_mm_movemask_epi8(c) & 0xffff;
+          if(bad) return(i + (16*k + __builtin_ctz(bad))/24);
+        }
+      }
+      return i;
+    };
+
+    __attribute__((target("avx2")))
+    static size_t validFramesAVX2(const unsigned char* p, size_t n){
+      const NibbleMasks& m = nibbleMasks();
+      size_t i = 0;
+      for(; i + 4 <= n; i += 4, p += 96){
+        for(int k = 0; k < 3; ++k){
+          __m256i v = _mm256_loadu_si256((const __m256i*)(p + 32*k));
+          __m256i c = _mm256_cmpeq_epi8(_mm256_and_si256(v, _mm256_loadu_si256((const __m256i*)(m.mask + 32*k))),
+                                        _mm256_loadu_si256((const __m256i*)(m.want + 32*k)));
+          unsigned bad = ~(unsigned)_mm256_movemask_epi8(c);
+          if(bad) return(i + (32*k + __builtin_ctz(bad))/24);
+        }
+      }
+      return(i + validFramesSSE2(p, n - i));
+    };
+
+    //! First candidate offset with all three nibbles, as long as the loads stay inside [p,p+len).
+    static size_t findFrameSSE2(const unsigned char* p, size_t len){
+      const __m128i hi = _mm_set1_epi8((char)0xf0);
+      const __m128i a  = _mm_set1_epi8((char)0xa0);
+      const __m128i c  = _mm_set1_epi8((char)0xc0);
+      const __m128i e  = _mm_set1_epi8((char)0xe0);
+      size_t j = 0;
+      for(; j + 5 + 16 <= len; j += 16){
+        __m128i m1 = _mm_cmpeq_epi8(_mm_and_si128(_mm_loadu_si128((const __m128i*)(p + j + 1)), hi), a);
+        __m128i m3 = _mm_cmpeq_epi8(_mm_and_si128(_mm_loadu_si128((const __m128i*)(p + j + 3)), hi), c);
+        __m128i m5 = _mm_cmpeq_epi8(_mm_and_si128(_mm_loadu_si128((const __m128i*)(p + j + 5)), hi), e);
+        unsigned m = _mm_movemask_epi8(_mm_and_si128(m1, _mm_and_si128(m3, m5)));
+        if(m) return(j + __builtin_ctz(m));
+      }
+      return j;
+    };
+
+    __attribute__((target("avx2")))
+    static size_t findFrameAVX2(const unsigned char* p, size_t len){
+      const __m256i hi = _mm256_set1_epi8((char)0xf0);
+      const __m256i a  = _mm256_set1_epi8((char)0xa0);
+      const __m256i c  = _mm256_set1_epi8((char)0xc0);
+      const __m256i e  = _mm256_set1_epi8((char)0xe0);
+      size_t j = 0;
+      for(; j + 5 + 32 <= len; j += 32){
+        __m256i m1 = _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(p + j + 1)), hi), a);
+        __m256i m3 = _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(p + j + 3)), hi), c);
+        __m256i m5 = _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(p + j + 5)), hi), e);
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(m1, _mm256_and_si256(m3, m5)));
+        if(m) return(j + __builtin_ctz(m));
+      }
+      return(j + findFrameSSE2(p + j, len - j));
+    };
+#endif
+};
+
+#endif
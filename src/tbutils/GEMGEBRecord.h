@@ -0,0 +1,98 @@
+#ifndef GEM_GEBRecord
+#define GEM_GEBRecord
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMGEBRecord                                                         //
+//                                                                      //
+// GEB record of VFAT2 frames and its readers from the hex text and     //
+// the binary stream, shared by gem-reading, gem-convert and            //
+// gem-tree-bench                                                       //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <vector>
+
+#include "GEMBinaryReader.h"
+#include "GEMHexReader.h"
+#include "GEMBitFields.h"
+
+//! GEB record and its readers.
+/*!
+  \brief GEMGEBRecord
+  header, sumVFAT VFAT2 frames and trailer, as in DataParker.dat (one hex token
+  per word, six per frame) and in the binary layout of GEMBinaryReader.
+
+  readGEB() reads a record as it is, without any check of the control bits;
+  gem-reading builds its checked and resynchronising readers on readHeader(),
+  readVFAT() and readTrailer().
+
+    GEMGEBRecord::GEBData geb;
+    while(GEMGEBRecord::readGEB(inpf, geb)) ...
+ */
+
+class GEMGEBRecord {
+  public:
+
+      //! GEM Event Data Format (one chip data)
+      struct VFATData {
+        uint16_t BC;      /*!<Banch Crossing number "BC" 16 bits, : 1010:4 (control bits), BC:12 */
+        uint16_t EC;      /*!<Event Counter "EC" 16 bits: 1100:4(control bits) , EC:8, Flag:4 */
+        uint32_t bxExp;
+        uint16_t bxNum;   /*!<Event Number & SBit, 16 bits : bxNum:6, SBit:6 */
+        uint16_t ChipID;  /*!<ChipID 16 bits, 1110:4 (control bits), ChipID:12 */
+        uint64_t lsData;  /*!<lsData value, bits from 1to64. */
+        uint64_t msData;  /*!<msData value, bits from 65to128. */
+        uint16_t crc;     /*!<Checksum number, CRC:16 */
+        bool crcOK;       /*!<crc matches GEMCrc16::vfat2 of the frame, set by the gem-reading readers */
+      };
+
+      struct GEBData {
+        uint64_t header;      // ZSFlag:24 ChamID:12 sumVFAT:28
+        std::vector<VFATData> vfats;
+        uint64_t trailer;     // OHcrc: 16 OHwCount:16  ChamStatus:16
+      };
+
+      static bool readHeader(GEMHexReader& inpf, GEBData& geb){ return(inpf.readHex(geb.header)); }
+      static bool readHeader(GEMBinaryReader& inpf, GEBData& geb){ return(inpf.readWord(geb.header)); }
+      static bool readTrailer(GEMHexReader& inpf, GEBData& geb){ return(inpf.readHex(geb.trailer)); }
+      static bool readTrailer(GEMBinaryReader& inpf, GEBData& geb){ return(inpf.readWord(geb.trailer)); }
+
+      //! One VFAT2 frame: BC, EC, ChipID, lsData, msData, crc.
+      static bool readVFAT(GEMHexReader& inpf, VFATData& vfat){
+        inpf.readHex(vfat.BC);
+        inpf.readHex(vfat.EC);
+        inpf.readHex(vfat.ChipID);
+        inpf.readHex(vfat.lsData);
+        inpf.readHex(vfat.msData);
+        inpf.readHex(vfat.crc);
+        return(!inpf.fail());
+      };
+
+      static bool readVFAT(GEMBinaryReader& inpf, VFATData& vfat){ return(inpf.readVFAT(vfat)); }
+
+      //! Read one DataParker GEB record: header, sumVFAT frames of six words, trailer.
+      static bool readGEB(GEMHexReader& inpf, GEBData& geb){
+        if(!readHeader(inpf, geb)) return(false);
+        uint64_t sumVFAT = GEMBits::GEBHeader::SumVFAT::get(geb.header);
+        if(sumVFAT > 0xffff) return(false);
+        geb.vfats.resize(sumVFAT);
+        for(uint64_t ivfat=0; ivfat<sumVFAT; ivfat++)
+          if(!readVFAT(inpf, geb.vfats[ivfat])) return(false);
+        return(readTrailer(inpf, geb));
+      };
+
+      //! Read one binary GEB record, sumVFAT is bounded by the frames left in the file.
+      static bool readGEB(GEMBinaryReader& inpf, GEBData& geb){
+        if(!readHeader(inpf, geb)) return(false);
+        uint64_t sumVFAT = GEMBits::GEBHeader::SumVFAT::get(geb.header);
+        if(sumVFAT > inpf.remainingVFATs()) return(false);
+        geb.vfats.resize(sumVFAT);
+        for(uint64_t ivfat=0; ivfat<sumVFAT; ivfat++)
+          if(!readVFAT(inpf, geb.vfats[ivfat])) return(false);
+        return(readTrailer(inpf, geb));
+      };
+};
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef GEM_HexReader
+#define GEM_HexReader
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMHexReader                                                         //
+//                                                                      //
+// Block based tokenizer for the hex text .dat files, replaces          //
+// "ifstream >> hex >> x" in the readers                                //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEM_HEXREADER_X86 1
+#endif
+
+//! Hex text reader.
+/*!
+  \brief GEMHexReader
+  reads the file in large blocks, finds token boundaries with SSE2/AVX2 compares
+  (scalar loop elsewhere) and converts hex digits through a lookup table.
+  Whitespace is any byte <= ' ', as for the stream extraction.
+ */
+
+class GEMHexReader {
+  public:
+    static const size_t kDefaultBlock = 1 << 20;
+
+    explicit GEMHexReader(size_t blockSize = kDefaultBlock) :
+      fd(-1), block(blockSize), buf(blockSize + kPad), pos(0), end(0), fileOffset(0), fEOF(false), fFail(false), fFollow(false), fEnded(false) {}
+    ~GEMHexReader(){ close(); }
+
+    bool open(const std::string& file){
+      close();
+      fd = ::open(file.c_str(), O_RDONLY);
+      return(fd >= 0);
+    };
+
+    void close(){
+      if(fd >= 0) ::close(fd);
+      fd = -1; pos = end = 0; fileOffset = 0; fEOF = false; fFail = false; fEnded = false;
+    };
+
+    bool is_open() const { return fd >= 0; }
+    bool fail()    const { return fFail; }
+    //! The last read failed because the data ended, not because of a bad token.
+    bool ended()   const { return fEnded; }
+    //! false once a read failed or no token is left in the file
+    bool good()          { return is_open() && !fFail && skipSpace(); }
+    bool eof()           { return !skipSpace(); }
+
+    //! File offset of the first byte not consumed yet.
+    size_t tell() const { return fileOffset + pos; }
+
+    //! Go back (or forward) to a file offset from tell(), clears the fail and end of file state.
+    bool seek(size_t offset){
+      if(fd < 0) return(false);
+      fFail = false; fEOF = false; fEnded = false;
+      if(offset >= fileOffset && offset <= fileOffset + end){
+        pos = offset - fileOffset;
+        return(true);
+      }
+      if(lseek(fd, offset, SEEK_SET) < 0) return(setFail());
+      fileOffset = offset; pos = end = 0;
+      return(true);
+    };
+
+    //! Follow mode: the file may still grow, a token touching the end of the data is not complete yet.
+    void setFollow(bool follow){ fFollow = follow; }
+
+    //! Next token as hex number, an optional 0x prefix is accepted, false if it does not fit in T.
+    template <class T>
+    bool readHex(T& v){
+      const char* p; size_t n;
+      if(!token(p, n)) return(false);
+      if(n > 2 && p[0] == '0' && (p[1] | 0x20) == 'x'){ p += 2; n -= 2; }
+      uint64_t x = 0;
+      uint8_t bad = 0;
+      for(size_t i = 0; i < n; ++i){
+        uint8_t d = hexTable()[(unsigned char)p[i]];
+        bad |= d;
+        x = (x << 4) | (d & 0xf);
+      }
+      // a value wider than T fails, as the stream extraction it replaces
+      if((bad & 0x80) || n == 0 || n > 16 || x > uint64_t(std::numeric_limits<T>::max())) return(setFail());
+      v = static_cast<T>(x);
+      return(true);
+    };
+
+    //! Drop the next token, e.g. to resynchronise after damaged data.
+    bool skipToken(){
+      const char* p; size_t n;
+      return(token(p, n));
+    };
+
+    bool readDec(int& v){
+      char tmp[32];
+      if(!tokenCopy(tmp, sizeof(tmp))) return(false);
+      char* e; long x = strtol(tmp, &e, 10);
+      if(*e) return(setFail());
+      v = static_cast<int>(x);
+      return(true);
+    };
+
+    bool readDouble(double& v){
+      char tmp[64];
+      if(!tokenCopy(tmp, sizeof(tmp))) return(false);
+      char* e; double x = strtod(tmp, &e);
+      if(*e) return(setFail());
+      v = x;
+      return(true);
+    };
+
+  protected:
+    static const size_t kPad = 64;
+
+    bool setFail(){ fFail = true; return(false); }
+
+    //! Make sure there is a non whitespace byte at pos, refilling as needed.
+    bool skipSpace(){
+      for(;;){
+        pos = findToken(&buf[0] + pos, &buf[0] + end) - &buf[0];
+        if(pos < end) return(true);
+        if(!refill()) return(false);
+      }
+    };
+
+    //! Locate the next token, it stays valid until the next read.
+    bool token(const char*& p, size_t& n){
+      if(fFail) return(false);
+      if(!skipSpace()){ fEnded = true; return(setFail()); }
+      for(;;){
+        const char* b = &buf[0] + pos;
+        const char* e = findSpace(b, &buf[0] + end);
+        if(e < &buf[0] + end || (fEOF && !fFollow)){
+          p = b; n = e - b;
+          pos = e - &buf[0];
+          return(true);
+        }
+        // token runs into the end of the block
+        if(!refill() && (!fEOF || fFollow)){ fEnded = true; return(setFail()); }
+      }
+    };
+
+    bool tokenCopy(char* tmp, size_t size){
+      const char* p; size_t n;
+      if(!token(p, n)) return(false);
+      if(n >= size) return(setFail());
+      std::memcpy(tmp, p, n); tmp[n] = 0;
+      return(true);
+    };
+
+    //! Keep the unconsumed tail, append the next block. False if nothing new was read.
+    bool refill(){
+      if(fd < 0 || fEOF) return(false);
+      size_t keep = end - pos;
+      if(keep && pos) std::memmove(&buf[0], &buf[0] + pos, keep);
+      fileOffset += pos;
+      pos = 0; end = keep;
+      if(end + block > buf.size() - kPad) buf.resize(end + block + kPad);
+      ssize_t got = ::read(fd, &buf[0] + end, buf.size() - kPad - end);
+      if(got <= 0){ fEOF = true; return(false); }
+      end += got;
+      std::memset(&buf[0] + end, ' ', kPad); // sentinel, vector loads may run past end
+      return(true);
+    };
+
+    //! 0-15 for hex digits, 0x80 otherwise
+    struct HexTable {
+      uint8_t v[256];
+      HexTable(){
+        for(int c = 0; c < 256; ++c) v[c] = 0x80;
+        for(int c = 0; c < 10; ++c) v['0' + c] = c;
+        for(int c = 0; c < 6; ++c) v['a' + c] = v['A' + c] = 10 + c;
+      }
+    };
+    static const uint8_t* hexTable(){ static const HexTable table; return table.v; }
+
+    // first byte > ' ' / first byte <= ' ' in [p,e), e if none
+    static const char* findToken(const char* p, const char* e){ return scan(p, e, false); }
+    static const char* findSpace(const char* p, const char* e){ return scan(p, e, true);  }
+
+    static const char* scan(const char* p, const char* e, bool space){
+#ifdef GEM_HEXREADER_X86
+      static const bool avx2 = __builtin_cpu_supports("avx2");
+      if(avx2) return scanAVX2(p, e, space);
+      return scanSSE2(p, e, space);
+#else
+      return scanScalar(p, e, space);
+#endif
+    };
+
+    static const char* scanScalar(const char* p, const char* e, bool space){
+      for(; p < e; ++p) if(((unsigned char)*p <= ' ') == space) return p;
+      return e;
+    };
+
+#ifdef GEM_HEXREADER_X86
+    static const char* scanSSE2(const char* p, const char* e, bool space){
+      const __m128i sp = _mm_set1_epi8(' ');
+      const unsigned flip = space ? 0 : 0xffff;
+      for(; p < e; p += 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i le = _mm_cmpeq_epi8(_mm_min_epu8(v, sp), v);   // v <= ' '
+        unsigned m = (_mm_movemask_epi8(le) ^ flip) & 0xffff;
+        if(m){ const char* r = p + __builtin_ctz(m); return r < e ? r : e; }
+      }
+      return e;
+    };
+
+    __attribute__((target("avx2")))
+    static const char* scanAVX2(const char* p, const char* e, bool space){
+      const __m256i sp = _mm256_set1_epi8(' ');
+      const unsigned flip = space ? 0 : 0xffffffff;
+      for(; p < e; p += 32){
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i le = _mm256_cmpeq_epi8(_mm256_min_epu8(v, sp), v);
+        unsigned m = (unsigned)_mm256_movemask_epi8(le) ^ flip;
+        if(m){ const char* r = p + __builtin_ctz(m); return r < e ? r : e; }
+      }
+      return e;
+    };
+#endif
+
+    int               fd;
+    size_t            block;
+    std::vector<char> buf;
+    size_t            pos;        // next byte in buf
+    size_t            end;        // end of valid data in buf
+    size_t            fileOffset; // file offset of buf[0]
+    bool              fEOF;
+    bool              fFail;
+    bool              fFollow;
+    bool              fEnded;     // failed at the end of the data
+
+  private:
+    GEMHexReader(const GEMHexReader&);
+    GEMHexReader& operator=(const GEMHexReader&);
+};
+
+#endif
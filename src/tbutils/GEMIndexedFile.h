@@ -0,0 +1,241 @@
+#ifndef GEM_IndexedFile
+#define GEM_IndexedFile
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMIndexedWriter, GEMIndexedReader                                   //
+//                                                                      //
+// Binary GEB container with an event offset table in the footer        //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "GEMBinaryReader.h"
+#include "GEMDataWriter.h"
+
+//! Indexed GEB file layout, host byte order.
+/*!
+    "GEMIDX01"                       8 bytes file magic
+    GEB records                      binary layout of GEMBinaryReader
+    Entry[nEntries]                  24 bytes each, in the order the records were written
+    uint64_t indexOffset
+    uint64_t nEntries
+    "GEMIDXFT"                       8 bytes footer magic
+
+  The index is written on close(), a file without footer (writer crashed) can
+  still be read sequentially with GEMBinaryReader after the 8 byte file magic.
+ */
+
+namespace GEMIndexed {
+
+  static const char   kMagic[8]       = {'G','E','M','I','D','X','0','1'};
+  static const char   kFooterMagic[8] = {'G','E','M','I','D','X','F','T'};
+  static const size_t kFooterSize     = 24;
+
+  struct Entry {
+    uint64_t event;     /*!<event number given by the writer */
+    uint64_t offset;    /*!<file offset of the GEB header */
+    uint16_t EC;        /*!<EC:8 of the first VFAT2 frame */
+    uint16_t BC;        /*!<BC:12 of the first VFAT2 frame */
+    uint16_t ChamID;    /*!<ChamID:12 of the GEB header */
+    uint16_t nVFAT;     /*!<number of VFAT2 frames, saturated at 0xffff */
+  };
+
+}
+
+//! Indexed GEB file writer.
+/*!
+  \brief GEMIndexedWriter
+  call addEntry() before writing each GEB record to stream() with the
+  GEMOnline::write*Binary helpers, close() appends the index.
+ */
+
+class GEMIndexedWriter {
+  public:
+    GEMIndexedWriter() {}
+    ~GEMIndexedWriter(){ close(); }
+
+    bool open(const std::string& file){
+      entries.clear();
+      if(!out.open(file, false)) return(false);
+      return(out.write(GEMIndexed::kMagic, sizeof(GEMIndexed::kMagic)));
+    };
+
+    bool is_open() const { return out.is_open(); }
+
+    GEMDataWriter& stream(){ return out; }
+
+    //! The next GEB record written to stream() starts here.
+    void addEntry(uint64_t event, uint16_t EC, uint16_t BC, uint16_t ChamID, uint64_t nVFAT){
+      GEMIndexed::Entry e;
+      e.event  = event;
+      e.offset = out.bytesWritten();
+      e.EC     = EC;
+      e.BC     = BC;
+      e.ChamID = ChamID;
+      e.nVFAT  = nVFAT > 0xffff ? 0xffff : nVFAT;
+      entries.push_back(e);
+    };
+
+    //! Write the index and the footer, then close the file.
+    bool close(){
+      if(!out.is_open()) return(true);
+      uint64_t indexOffset = out.bytesWritten();
+      uint64_t nEntries    = entries.size();
+      for(size_t i = 0; i < entries.size(); ++i){
+        const GEMIndexed::Entry& e = entries[i];
+        out.writeBinary(e.event);
+        out.writeBinary(e.offset);
+        out.writeBinary(e.EC);
+        out.writeBinary(e.BC);
+        out.writeBinary(e.ChamID);
+        out.writeBinary(e.nVFAT);
+      }
+      out.writeBinary(indexOffset);
+      out.writeBinary(nEntries);
+      out.write(GEMIndexed::kFooterMagic, sizeof(GEMIndexed::kFooterMagic));
+      entries.clear();
+      return(out.close());
+    };
+
+  private:
+    GEMDataWriter                  out;
+    std::vector<GEMIndexed::Entry> entries;
+};
+
+//! Indexed GEB file reader.
+/*!
+  \brief GEMIndexedReader
+  maps the file, the index is used in place. Lookups by event number are a
+  binary search over the index, lookups by EC/BC and by ChamID use sorted
+  permutations which are built on first use.
+ */
+
+class GEMIndexedReader {
+  public:
+    GEMIndexedReader() : index(0), nEntries(0) {}
+
+    //! True if the file starts with the indexed file magic.
+    static bool isIndexed(const std::string& file){
+      GEMBinaryReader r;
+      if(!r.open(file)) return(false);
+      const unsigned char* p = r.peek(sizeof(GEMIndexed::kMagic));
+      return(p && std::memcmp(p, GEMIndexed::kMagic, sizeof(GEMIndexed::kMagic)) == 0);
+    };
+
+    bool open(const std::string& file){
+      index = 0; nEntries = 0; byECBC.clear(); byChamber.clear();
+      if(!in.open(file)) return(false);
+      size_t size = in.size();
+      if(size < sizeof(GEMIndexed::kMagic) + GEMIndexed::kFooterSize) return(false);
+      const unsigned char* base = in.data();
+      if(std::memcmp(base, GEMIndexed::kMagic, sizeof(GEMIndexed::kMagic)) != 0) return(false);
+      const unsigned char* footer = base + size - GEMIndexed::kFooterSize;
+      if(std::memcmp(footer + 16, GEMIndexed::kFooterMagic, sizeof(GEMIndexed::kFooterMagic)) != 0) return(false);
+      uint64_t indexOffset = GEMBinaryReader::load64(footer);
+      uint64_t n           = GEMBinaryReader::load64(footer + 8);
+      // the records between magic and index, n bounded first so that the size check can not overflow
+      if(indexOffset < sizeof(GEMIndexed::kMagic) || indexOffset > size - GEMIndexed::kFooterSize) return(false);
+      if(n > (size - GEMIndexed::kFooterSize - indexOffset)/kEntrySize) return(false);
+      if(indexOffset + n*kEntrySize + GEMIndexed::kFooterSize != size) return(false);
+      index    = base + indexOffset;
+      nEntries = n;
+      in.setEnd(indexOffset);
+      in.seek(sizeof(GEMIndexed::kMagic));
+      return(true);
+    };
+
+    //! Sequential reading of the GEB records, positioned at the first one after open().
+    GEMBinaryReader& stream(){ return in; }
+
+    size_t entries() const { return nEntries; }
+
+    GEMIndexed::Entry entry(size_t i) const {
+      const unsigned char* p = index + i*kEntrySize;
+      GEMIndexed::Entry e;
+      e.event  = GEMBinaryReader::load64(p);
+      e.offset = GEMBinaryReader::load64(p + 8);
+      e.EC     = GEMBinaryReader::load16(p + 16);
+      e.BC     = GEMBinaryReader::load16(p + 18);
+      e.ChamID = GEMBinaryReader::load16(p + 20);
+      e.nVFAT  = GEMBinaryReader::load16(p + 22);
+      return e;
+    };
+
+    //! Position stream() at the GEB record of entry i.
+    bool seekEntry(size_t i){ return(i < nEntries && in.seek(entry(i).offset)); }
+
+    //! First entry with this event number, entries() if there is none.
+    size_t findEvent(uint64_t event) const {
+      size_t lo = 0, hi = nEntries;
+      while(lo < hi){
+        size_t mid = lo + (hi - lo)/2;
+        if(GEMBinaryReader::load64(index + mid*kEntrySize) < event) lo = mid + 1;
+        else hi = mid;
+      }
+      return (lo < nEntries && GEMBinaryReader::load64(index + lo*kEntrySize) == event) ? lo : nEntries;
+    };
+
+    //! All entries with the given EC/BC of the first frame, in file order.
+    std::vector<size_t> findECBC(uint16_t EC, uint16_t BC){
+      if(byECBC.empty()) buildPermutation(byECBC, &GEMIndexedReader::keyECBC);
+      return(equalRange(byECBC, &GEMIndexedReader::keyECBC, (uint64_t(EC) << 16) | BC));
+    };
+
+    //! All entries of one chamber, in file order.
+    std::vector<size_t> findChamber(uint16_t ChamID){
+      if(byChamber.empty()) buildPermutation(byChamber, &GEMIndexedReader::keyChamber);
+      return(equalRange(byChamber, &GEMIndexedReader::keyChamber, ChamID));
+    };
+
+  private:
+    static const size_t kEntrySize = 24;
+
+    typedef uint64_t (GEMIndexedReader::*Key)(size_t) const;
+
+    uint64_t keyECBC(size_t i) const {
+      const unsigned char* p = index + i*kEntrySize;
+      return (uint64_t(GEMBinaryReader::load16(p + 16)) << 16) | GEMBinaryReader::load16(p + 18);
+    };
+    uint64_t keyChamber(size_t i) const { return GEMBinaryReader::load16(index + i*kEntrySize + 20); }
+
+    struct Less {
+      const GEMIndexedReader* r; Key key;
+      bool operator()(uint32_t a, uint32_t b) const {
+        uint64_t ka = (r->*key)(a), kb = (r->*key)(b);
+        return ka < kb || (ka == kb && a < b);
+      }
+    };
+
+    void buildPermutation(std::vector<uint32_t>& perm, Key key) const {
+      perm.resize(nEntries);
+      for(size_t i = 0; i < nEntries; ++i) perm[i] = i;
+      Less less = { this, key };
+      std::sort(perm.begin(), perm.end(), less);
+    };
+
+    std::vector<size_t> equalRange(const std::vector<uint32_t>& perm, Key key, uint64_t value) const {
+      size_t lo = 0, hi = perm.size();
+      while(lo < hi){
+        size_t mid = lo + (hi - lo)/2;
+        if((this->*key)(perm[mid]) < value) lo = mid + 1;
+        else hi = mid;
+      }
+      std::vector<size_t> found;
+      for(; lo < perm.size() && (this->*key)(perm[lo]) == value; ++lo) found.push_back(perm[lo]);
+      return found;
+    };
+
+    GEMBinaryReader       in;
+    const unsigned char*  index;
+    size_t                nEntries;
+    std::vector<uint32_t> byECBC;
+    std::vector<uint32_t> byChamber;
+};
+
+#endif
@@ -0,0 +1,247 @@
+#ifndef GEM_Occupancy
+#define GEM_Occupancy
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMOccupancy                                                         //
+//                                                                      //
+// Channel occupancy of every VFAT2 chip: whole 128 bit frames added    //
+// into bit-sliced counters, SSE2 for the add, AVX2 for the flush into  //
+// the 64 bit totals, scalar code elsewhere                             //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+
+#include <TH1.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEM_OCCUPANCY_X86 1
+#include <immintrin.h>
+#endif
+
+//! Fired channel counts of one VFAT2 chip, bit-sliced.
+/*!
+  \brief GEMSlicedCounter
+  Eight 128 bit planes, bit c of plane k is bit k of the pending count of
+  channel c. add() puts a frame (msData:lsData) into the planes with a
+  ripple carry, one and/xor pair per plane on one SSE2 register where
+  there is one, about three times the rate of a walk over the fired bits.
+  After 255 frames, and on flush(), the planes are added to the 64 bit
+  per-channel totals; with AVX2, checked at run time, four channels per
+  instruction.
+ */
+
+class GEMSlicedCounter {
+  public:
+    static const int kChannels = 128;
+    static const int kPlanes   = 8;
+    static const unsigned kFlush = (1u << kPlanes) - 1;
+
+    GEMSlicedCounter() : pending(0) {
+      std::fill(&plane[0][0], &plane[0][0] + 2*kPlanes, 0);
+      std::fill(total, total + kChannels, 0);
+    };
+
+    static bool hasAVX2(){
+#ifdef GEM_OCCUPANCY_X86
+      return __builtin_cpu_supports("avx2");
+#else
+      return false;
+#endif
+    };
+
+    //! One frame, bit c of msData:lsData set when channel c fired.
+    void add(const uint64_t lsData, const uint64_t msData, const bool avx2){
+      addSliced(lsData, msData);
+      if(++pending == kFlush) flush(avx2);
+    };
+
+    //! Move the pending counts into the totals.
+    void flush(const bool avx2){
+      if(!pending) return;
+#ifdef GEM_OCCUPANCY_X86
+      if(avx2) flushAVX2();
+      else
+#endif
+      flushScalar();
+      std::fill(&plane[0][0], &plane[0][0] + 2*kPlanes, 0);
+      pending = 0;
+    };
+
+    //! Frames with channel chan fired, after flush().
+    uint64_t count(const int chan) const { return total[chan]; }
+
+    //! Add the totals of other, its pending counts are flushed first.
+    void merge(GEMSlicedCounter& other, const bool avx2){
+      other.flush(avx2);
+      for(int chan = 0; chan < kChannels; ++chan) total[chan] += other.total[chan];
+    };
+
+  private:
+    //! plane += msData:lsData, per bit.
+    void addSliced(const uint64_t lsData, const uint64_t msData){
+#if defined(GEM_OCCUPANCY_X86) && defined(__SSE2__)
+      // all planes without a test of the carry, the branch costs more than the four instructions
+      __m128i c = _mm_set_epi64x(msData, lsData);
+      for(int k = 0; k < kPlanes; ++k){
+        __m128i p = _mm_loadu_si128((const __m128i*)plane[k]);
+        __m128i carry = _mm_and_si128(p, c);
+        _mm_storeu_si128((__m128i*)plane[k], _mm_xor_si128(p, c));
+        c = carry;
+      }
+#else
+      uint64_t c0 = lsData, c1 = msData;
+      for(int k = 0; (c0 | c1) && k < kPlanes; ++k){
+        const uint64_t t0 = plane[k][0] & c0, t1 = plane[k][1] & c1;
+        plane[k][0] ^= c0;
+        plane[k][1] ^= c1;
+        c0 = t0;
+        c1 = t1;
+      }
+#endif
+    };
+
+    void flushScalar(){
+      for(int k = 0; k < kPlanes; ++k)
+        for(int h = 0; h < 2; ++h)
+          for(uint64_t w = plane[k][h]; w; w &= w - 1) total[64*h + __builtin_ctzll(w)] += 1u << k;
+    };
+
+#ifdef GEM_OCCUPANCY_X86
+    //! Four channels per step: their pending counts are the nibbles of the planes spread over four 64 bit lanes.
+    __attribute__((target("avx2")))
+    void flushAVX2(){
+      const __m256i bit  = _mm256_set_epi64x(8, 4, 2, 1);
+      const __m256i zero = _mm256_setzero_si256();
+      for(int chan = 0; chan < kChannels; chan += 4){
+        const int h = chan >> 6, shift = chan & 63;
+        __m256i sum = zero;
+        for(int k = 0; k < kPlanes; ++k){
+          const __m256i nibble = _mm256_set1_epi64x((plane[k][h] >> shift) & 0xf);
+          // lane j: 1 when bit j of the nibble is set, weighted 2^k
+          const __m256i set = _mm256_cmpeq_epi64(_mm256_and_si256(nibble, bit), bit);
+          sum = _mm256_add_epi64(sum, _mm256_and_si256(set, _mm256_set1_epi64x(1ll << k)));
+        }
+        __m256i t = _mm256_loadu_si256((const __m256i*)&total[chan]);
+        _mm256_storeu_si256((__m256i*)&total[chan], _mm256_add_epi64(t, sum));
+      }
+    };
+#endif
+
+    uint64_t plane[kPlanes][2];   // bit slices, [k][0] channels 0-63, [k][1] channels 64-127
+    uint64_t total[kChannels];
+    unsigned pending;             // frames in the planes
+};
+
+//! Per-ChipID fired channel counts.
+/*!
+  \brief GEMOccupancy
+  One GEMSlicedCounter per chip, found through a table over the 12 bit
+  ChipID and allocated on the first frame of the chip.
+
+    GEMOccupancy occupancy;
+    occupancy.add(ChipID, vfat.lsData, vfat.msData);
+    occupancy.fill(hiChip, ChipID);   // bin chan+1: frames with chan fired
+ */
+
+class GEMOccupancy {
+  public:
+    static const int kChannels = GEMSlicedCounter::kChannels;
+    static const int kChipIDs  = 0x1000;
+
+    GEMOccupancy() : slot(kChipIDs, -1), nFrames(0), avx2(GEMSlicedCounter::hasAVX2()) {}
+
+    //! The flush code in use.
+    const char* simd() const { return avx2 ? "avx2" : "scalar"; }
+
+    //! One frame of chip chipID, bit c of msData:lsData set when channel c fired.
+    void add(const uint16_t chipID, const uint64_t lsData, const uint64_t msData){
+      Chip& chip = get(chipID);
+      chip.counts.add(lsData, msData, avx2);
+      chip.frames++;
+      nFrames++;
+    };
+
+    //! Move every pending count into the totals, before count() and total().
+    void flush(){
+      for(size_t i = 0; i < chips.size(); ++i) chips[i].counts.flush(avx2);
+    };
+
+    //! The chips seen, increasing ChipID.
+    std::vector<uint16_t> chipIDs() const {
+      std::vector<uint16_t> ids;
+      for(size_t i = 0; i < chips.size(); ++i) ids.push_back(chips[i].id);
+      std::sort(ids.begin(), ids.end());
+      return ids;
+    };
+
+    //! Frames of all chips.
+    uint64_t frames() const { return nFrames; }
+    //! Frames of one chip, 0 if it was not seen.
+    uint64_t frames(const uint16_t chipID) const {
+      int i = slot[chipID & (kChipIDs - 1)];
+      return i < 0 ? 0 : chips[i].frames;
+    };
+    //! Frames of chip chipID with channel chan fired, after flush().
+    uint64_t count(const uint16_t chipID, const int chan) const {
+      int i = slot[chipID & (kChipIDs - 1)];
+      return i < 0 ? 0 : chips[i].counts.count(chan);
+    };
+    //! Frames of any chip with channel chan fired, after flush().
+    uint64_t total(const int chan) const {
+      uint64_t n = 0;
+      for(size_t i = 0; i < chips.size(); ++i) n += chips[i].counts.count(chan);
+      return n;
+    };
+
+    //! Add the counts of other chip by chip, e.g. of another decoding thread. Flushes other.
+    void merge(GEMOccupancy& other){
+      for(size_t i = 0; i < other.chips.size(); ++i){
+        Chip& o = other.chips[i];
+        Chip& chip = get(o.id);
+        chip.counts.merge(o.counts, avx2);
+        chip.frames += o.frames;
+      }
+      nFrames += other.nFrames;
+    };
+
+    //! Snapshot: bin chan+1 of the 128 bin h to the fired counts of chipID, of all chips when chipID < 0.
+    void fill(TH1* h, const int chipID = -1){
+      flush();
+      uint64_t n = 0;
+      for(int chan = 0; chan < kChannels; ++chan){
+        uint64_t c = chipID < 0 ? total(chan) : count(chipID, chan);
+        h->SetBinContent(chan + 1, c);
+        n += c;
+      }
+      h->SetEntries(n);
+    };
+
+  private:
+    struct Chip {
+      GEMSlicedCounter counts;
+      uint64_t         frames;
+      uint16_t         id;
+    };
+
+    Chip& get(const uint16_t chipID){
+      int& i = slot[chipID & (kChipIDs - 1)];
+      if(i < 0){
+        i = chips.size();
+        chips.push_back(Chip());
+        chips.back().frames = 0;
+        chips.back().id     = chipID & (kChipIDs - 1);
+      }
+      return chips[i];
+    };
+
+    std::vector<int>  slot;         // ChipID -> chips index, -1 not seen
+    std::vector<Chip> chips;
+    uint64_t          nFrames;
+    bool              avx2;
+};
+
+#endif
@@ -0,0 +1,385 @@
+#ifndef GEM_SCurveFit
+#define GEM_SCurveFit
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMSCurveFit, GEMSCurveFitter                                        //
+//                                                                      //
+// Error function fits of the threshold scan turn-on of every VFAT2     //
+// channel, seeded from the moments of the curve, on a thread pool      //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+#include <TDirectory.h>
+#include <TH1.h>
+#include <TH2.h>
+
+#include "GEMScanCounter.h"
+
+//! S-curve fit of one channel.
+/*!
+  \brief GEMSCurveFit
+  The fraction of frames with the channel fired at scan value x is fitted
+  with
+
+    f(x) = plateau/2 * erfc(s*(x - threshold)/(sqrt(2)*noise))
+
+  s = +1 for a curve falling with x, as the hits of a threshold scan, -1
+  for a rising one, plateau at most 1. It is a binomial maximum likelihood
+  fit, k of n frames at every step: a least squares fit with the variance
+  of the data, k(n-k)/n^3, gives the steps with no or all frames fired the
+  largest weight and the noise too small by 10-20% for 20 frames a step.
+
+  The derivative of f is a Gaussian of mean threshold and sigma noise, so
+  the mean and RMS of the step to step drops of the curve are the seed,
+  and the plateau its highest step. Fisher scoring, Gauss-Newton with the
+  binomial variance of f, damped as Levenberg-Marquardt, then converges in
+  about 4 iterations, no TF1 or Minuit, nothing shared: fit() may run on
+  any number of threads at once. The noise is kept above a tenth of a
+  step, a sharper turn-on has no finite maximum. The errors are from the
+  inverse Fisher information, chi2 is Pearson's.
+ */
+
+class GEMSCurveFit {
+  public:
+    enum Status { kOK = 0, kNoData, kNoTurnOn, kNotConverged, kOutOfRange, kNStatus };
+
+    static const int kMaxIterations = 50;
+    static const int kMinSteps      = 4;      // steps with frames, one more than the parameters
+    static constexpr double kMinTurnOn = 0.1;  // less between the lowest and the highest step is no turn-on
+    static constexpr double kMinNoise    = 0.1;    // in steps, a sharper turn-on is not resolved by the scan
+    static constexpr double kMinFraction = 1e-12;
+
+    static const char* statusName(const int status){
+      static const char* names[kNStatus] = { "ok", "no data", "no turn-on", "not converged", "out of range" };
+      return names[status];
+    };
+
+    struct Result {
+      Result() : threshold(0), noise(0), plateau(0), thresholdErr(0), noiseErr(0), chi2(0), ndf(0), iterations(0), status(kNoData) {}
+      double threshold;     // scan value at half the plateau
+      double noise;         // sigma of the turn-on
+      double plateau;
+      double thresholdErr;
+      double noiseErr;
+      double chi2;
+      int    ndf;
+      int    iterations;
+      int    status;
+    };
+
+    //! Fit channel chan of counts over the steps 1..nBins, counts flushed.
+    static Result fit(const GEMScanCounter& counts, const int chan){
+      std::vector<Point> pts;
+      for(int b = 1; b <= counts.getNbins(); ++b){
+        Point pt;
+        pt.n = counts.getFrames(b);
+        if(pt.n == 0) continue;
+        pt.k = counts.count(b, chan);
+        pt.x = counts.center(b);
+        pt.p = pt.k/pt.n;
+        pts.push_back(pt);
+      }
+      return(fit(pts, counts.getXlow(), counts.getXup(), (counts.getXup() - counts.getXlow())/counts.getNbins()));
+    };
+
+  private:
+    struct Point {
+      double x;
+      double k;             // frames fired
+      double n;             // frames
+      double p;             // k/n
+    };
+
+    static Result fit(const std::vector<Point>& pts, const double xlow, const double xup, const double step){
+      Result r;
+      const int n = pts.size();
+      if(n < kMinSteps) return(r);
+
+      double pmin = pts[0].p, pmax = pts[0].p, first = 0, last = 0;
+      for(int i = 0; i < n; ++i){
+        pmin = std::min(pmin, pts[i].p);
+        pmax = std::max(pmax, pts[i].p);
+        if(2*i < n) first += pts[i].p; else last += pts[i].p;
+      }
+      r.ndf = n - 3;
+      if(pmax - pmin < kMinTurnOn){ r.status = kNoTurnOn; return(r); }
+      const double s = (first/(n/2) >= last/(n - n/2)) ? 1. : -1.;
+
+      // seed: the drops between steps are the Gaussian derivative of the curve
+      double sw = 0, swx = 0, swxx = 0;
+      for(int i = 0; i + 1 < n; ++i){
+        const double d = s*(pts[i].p - pts[i+1].p);
+        if(d <= 0) continue;
+        const double x = 0.5*(pts[i].x + pts[i+1].x);
+        sw += d; swx += d*x; swxx += d*x*x;
+      }
+      if(sw == 0){ r.status = kNoTurnOn; return(r); }
+      double q[3];
+      q[0] = swx/sw;
+      q[1] = std::max(std::sqrt(std::max(swxx/sw - q[0]*q[0], 0.)), 0.5*step);
+      q[2] = std::min(pmax, 1.);
+
+      // Fisher scoring, damped
+      double lambda = 1e-3, H[3][3], g[3], chi2;
+      double nll = likelihood(pts, s, q, H, g, chi2);
+      bool converged = false;
+      while(r.iterations < kMaxIterations && !converged){
+        r.iterations++;
+        double A[3][3], delta[3], t[3];
+        for(int a = 0; a < 3; ++a){
+          for(int b = 0; b < 3; ++b) A[a][b] = H[a][b];
+          A[a][a] *= 1 + lambda;
+        }
+        if(!solve(A, g, delta)){ lambda *= 10; continue; }
+        for(int a = 0; a < 3; ++a) t[a] = q[a] + delta[a];
+        t[1] = std::max(t[1], kMinNoise*step);
+        t[2] = std::min(t[2], 1.);
+        if(t[2] <= 0){ lambda *= 10; continue; }
+        double Ht[3][3], gt[3], chi2t;
+        const double nllt = likelihood(pts, s, t, Ht, gt, chi2t);
+        if(!(nllt <= nll)){
+          lambda *= 10;
+          converged = lambda > 1e10;      // no step raises the likelihood any more, at the maximum
+          continue;
+        }
+        converged = nll - nllt < 1e-9*std::fabs(nll) + 1e-12;
+        for(int a = 0; a < 3; ++a){
+          q[a] = t[a]; g[a] = gt[a];
+          for(int b = 0; b < 3; ++b) H[a][b] = Ht[a][b];
+        }
+        nll  = nllt;
+        chi2 = chi2t;
+        lambda = std::max(lambda/10, 1e-9);
+        // no turn-on in the scan, e.g. too few frames: the threshold runs away, no need to follow it
+        if(std::fabs(q[0] - 0.5*(xlow + xup)) > xup - xlow) break;
+      }
+
+      double C[3][3];
+      r.threshold = q[0];
+      r.noise     = q[1];
+      r.plateau   = q[2];
+      r.chi2      = chi2;
+      if(invert(H, C)){
+        r.thresholdErr = std::sqrt(std::max(C[0][0], 0.));
+        r.noiseErr     = std::sqrt(std::max(C[1][1], 0.));
+      }
+      if(q[0] < xlow || q[0] > xup || q[1] > xup - xlow) r.status = kOutOfRange;
+      else if(!converged)                                     r.status = kNotConverged;
+      else                                                    r.status = kOK;
+      return(r);
+    };
+
+    //! Binomial -log likelihood at q, H the Fisher information J^T W J and g the score J^T W (p - f), W = n/(f(1-f)).
+    static double likelihood(const std::vector<Point>& pts, const double s, const double* q, double H[3][3], double* g, double& chi2){
+      for(int a = 0; a < 3; ++a){
+        g[a] = 0;
+        for(int b = 0; b < 3; ++b) H[a][b] = 0;
+      }
+      // a copy, std::min and std::max take references and the class is header only, no out-of-class definition
+      const double fmin = kMinFraction, fmax = 1 - kMinFraction;
+      double nll = 0;
+      chi2 = 0;
+      for(size_t i = 0; i < pts.size(); ++i){
+        const Point& pt = pts[i];
+        const double z  = s*(pt.x - q[0])/(M_SQRT2*q[1]);
+        const double e  = 0.5*std::erfc(z);
+        const double f  = std::min(std::max(q[2]*e, fmin), fmax);
+        const double dz = -q[2]*std::exp(-z*z)/std::sqrt(M_PI);     // df/dz
+        const double J[3] = { -dz*s/(M_SQRT2*q[1]), -dz*z/q[1], e };
+        const double w   = pt.n/(f*(1 - f));
+        const double res = pt.p - f;
+        nll  -= pt.k*std::log(f) + (pt.n - pt.k)*std::log(1 - f);
+        chi2 += w*res*res;
+        for(int a = 0; a < 3; ++a){
+          g[a] += w*J[a]*res;
+          for(int b = 0; b < 3; ++b) H[a][b] += w*J[a]*J[b];
+        }
+      }
+      return(nll);
+    };
+
+    static double det(const double M[3][3]){
+      return M[0][0]*(M[1][1]*M[2][2] - M[1][2]*M[2][1])
+           - M[0][1]*(M[1][0]*M[2][2] - M[1][2]*M[2][0])
+           + M[0][2]*(M[1][0]*M[2][1] - M[1][1]*M[2][0]);
+    };
+
+    //! C = M^-1 by cofactors, false if M is singular.
+    static bool invert(const double M[3][3], double C[3][3]){
+      const double d = det(M);
+      if(!(std::fabs(d) > 0) || !std::isfinite(d)) return(false);
+      for(int a = 0; a < 3; ++a){
+        for(int b = 0; b < 3; ++b){
+          const int a1 = (b + 1)%3, a2 = (b + 2)%3, b1 = (a + 1)%3, b2 = (a + 2)%3;
+          C[a][b] = (M[a1][b1]*M[a2][b2] - M[a1][b2]*M[a2][b1])/d;
+        }
+      }
+      return(true);
+    };
+
+    static bool solve(const double M[3][3], const double* y, double* x){
+      double C[3][3];
+      if(!invert(M, C)) return(false);
+      for(int a = 0; a < 3; ++a) x[a] = C[a][0]*y[0] + C[a][1]*y[1] + C[a][2]*y[2];
+      return(true);
+    };
+};
+
+//! S-curve fits of all channels of all chips of a scan.
+/*!
+  \brief GEMSCurveFitter
+  fit() hands the chips out to nJobs threads one at a time, a chip's 128
+  fits are independent of all others and go to fixed places in results,
+  so they are the same for any number of threads. write() books, writes
+  and deletes:
+
+    Threshold, Noise          TH2F channel x chip (ChipID bin labels), fits "ok" only
+    ThresholdDist, NoiseDist  TH1F of the "ok" fits
+    FitStatus                 TH1F, fits per GEMSCurveFit::Status
+    Chips/Threshold_0x<chip>  TH1F threshold per channel with its error, bin chan+1
+    Chips/Noise_0x<chip>      TH1F noise per channel with its error
+
+    GEMSCurveFitter fitter;
+    fitter.fit(counts, nJobs);
+    fitter.write(hfile->mkdir("SCurve"));
+ */
+
+class GEMSCurveFitter {
+  public:
+    static const int kChannels = GEMScanCounter::kChannels;
+
+    GEMSCurveFitter() : xlow(0), xup(1) {}
+
+    void fit(GEMScanChips& chips, unsigned nJobs){
+      ids = chips.ids();
+      xlow = chips.all.getXlow();
+      xup  = chips.all.getXup();
+      std::vector<GEMScanCounter*> curves;
+      for(size_t i = 0; i < ids.size(); ++i){
+        curves.push_back(&chips.get(ids[i]));
+        curves.back()->flush();
+      }
+      results.assign(ids.size()*kChannels, GEMSCurveFit::Result());
+
+      std::atomic<size_t> next(0);
+      auto work = [&](){
+        for(size_t i = next++; i < curves.size(); i = next++)
+          for(int chan = 0; chan < kChannels; ++chan) results[i*kChannels + chan] = GEMSCurveFit::fit(*curves[i], chan);
+      };
+      if(nJobs == 0) nJobs = 1;
+      std::vector<std::thread> workers;
+      for(unsigned i = 1; i < nJobs && i < curves.size(); ++i) workers.push_back(std::thread(work));
+      work();
+      for(size_t i = 0; i < workers.size(); ++i) workers[i].join();
+    };
+
+    size_t chips() const { return ids.size(); }
+    uint16_t chipID(const size_t i) const { return ids[i]; }
+    const GEMSCurveFit::Result& result(const size_t i, const int chan) const { return results[i*kChannels + chan]; }
+
+    //! Fits with status.
+    uint64_t count(const int status) const {
+      uint64_t n = 0;
+      for(size_t i = 0; i < results.size(); ++i) if(results[i].status == status) n++;
+      return n;
+    };
+
+    //! Mean threshold, noise and iterations of the "ok" fits.
+    void means(double& threshold, double& noise, double& iterations) const {
+      threshold = noise = iterations = 0;
+      uint64_t n = 0;
+      for(size_t i = 0; i < results.size(); ++i){
+        if(results[i].status != GEMSCurveFit::kOK) continue;
+        threshold  += results[i].threshold;
+        noise      += results[i].noise;
+        iterations += results[i].iterations;
+        n++;
+      }
+      if(n){ threshold /= n; noise /= n; iterations /= n; }
+    };
+
+    void write(TDirectory* dir){
+      const int nChips = ids.size(), nRows = std::max(nChips, 1);
+      char name[64], title[96];
+      TH2F* hThreshold = new TH2F("Threshold", "S-curve threshold;channel;ChipID", kChannels, 0., kChannels, nRows, 0., nRows);
+      TH2F* hNoise     = new TH2F("Noise", "S-curve noise;channel;ChipID", kChannels, 0., kChannels, nRows, 0., nRows);
+      TH1F* hThrDist   = new TH1F("ThresholdDist", "S-curve threshold of all channels", 100, xlow, xup);
+      TH1F* hNoiseDist = new TH1F("NoiseDist", "S-curve noise of all channels", 100, 0., (xup - xlow)/10);
+      TH1F* hStatus    = new TH1F("FitStatus", "S-curve fit status", GEMSCurveFit::kNStatus, -0.5, GEMSCurveFit::kNStatus - 0.5);
+      for(int s = 0; s < GEMSCurveFit::kNStatus; ++s){
+        hStatus->GetXaxis()->SetBinLabel(s + 1, GEMSCurveFit::statusName(s));
+        hStatus->SetBinContent(s + 1, count(s));
+      }
+      hStatus->SetEntries(results.size());
+
+      TDirectory* chipDir = dir->mkdir("Chips");
+      for(int i = 0; i < nChips; ++i){
+        snprintf(name, sizeof(name), "0x%03x", ids[i]);
+        hThreshold->GetYaxis()->SetBinLabel(i + 1, name);
+        hNoise->GetYaxis()->SetBinLabel(i + 1, name);
+
+        snprintf(name, sizeof(name), "Threshold_0x%03x", ids[i]);
+        snprintf(title, sizeof(title), "ChipID 0x%03x S-curve threshold;channel", ids[i]);
+        TH1F* hChipThr = book(name, title);
+        snprintf(name, sizeof(name), "Noise_0x%03x", ids[i]);
+        snprintf(title, sizeof(title), "ChipID 0x%03x S-curve noise;channel", ids[i]);
+        TH1F* hChipNoise = book(name, title);
+
+        uint64_t nOK = 0;
+        for(int chan = 0; chan < kChannels; ++chan){
+          const GEMSCurveFit::Result& r = result(i, chan);
+          if(r.status != GEMSCurveFit::kOK) continue;
+          hThreshold->SetBinContent(chan + 1, i + 1, r.threshold);
+          hNoise->SetBinContent(chan + 1, i + 1, r.noise);
+          hThrDist->Fill(r.threshold);
+          hNoiseDist->Fill(r.noise);
+          hChipThr->SetBinContent(chan + 1, r.threshold);
+          hChipThr->SetBinError(chan + 1, r.thresholdErr);
+          hChipNoise->SetBinContent(chan + 1, r.noise);
+          hChipNoise->SetBinError(chan + 1, r.noiseErr);
+          nOK++;
+        }
+        save(chipDir, hChipThr, nOK);
+        save(chipDir, hChipNoise, nOK);
+      }
+      hThreshold->SetEntries(count(GEMSCurveFit::kOK));
+      hNoise->SetEntries(count(GEMSCurveFit::kOK));
+
+      TH1* summary[5] = { hThreshold, hNoise, hThrDist, hNoiseDist, hStatus };
+      for(int h = 0; h < 5; ++h){
+        summary[h]->SetDirectory(0);
+        dir->WriteTObject(summary[h]);
+        delete summary[h];
+      }
+    };
+
+  private:
+    static TH1F* book(const char* name, const char* title){
+      TH1F* h = new TH1F(name, title, kChannels, 0., kChannels);
+      h->SetDirectory(0);
+      h->SetFillColor(48);
+      return h;
+    };
+
+    static void save(TDirectory* dir, TH1F* h, const uint64_t entries){
+      h->SetEntries(entries);
+      dir->WriteTObject(h);
+      delete h;
+    };
+
+    std::vector<uint16_t>             ids;       // ChipIDs, ascending
+    std::vector<GEMSCurveFit::Result> results;   // chip major, 128 per chip
+    double                            xlow;
+    double                            xup;
+};
+
+#endif
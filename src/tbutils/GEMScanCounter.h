@@ -0,0 +1,220 @@
+#ifndef GEM_ScanCounter
+#define GEM_ScanCounter
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMScanCounter, GEMScanChips                                         //
+//                                                                      //
+// Threshold scan counts of the 128 VFAT2 channels, one integer per     //
+// (threshold step, channel), turned into TH1 only when they are shown  //
+// or written                                                           //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <vector>
+#include <stdint.h>
+
+#include <TH1.h>
+
+#include "GEMBitFields.h"
+
+//! Dense (threshold step, channel) counter matrix.
+/*!
+  \brief GEMScanCounter
+  add() takes one VFAT2 frame. Every step has eight bit planes per data
+  word, bit c of plane k is bit k of the pending count of channel c, so a
+  frame is added to all 128 channels at once with a few and/xor per word,
+  whatever its occupancy. The planes are moved into the 32 bit counts
+  before they can overflow, every 255 frames of a step, and by flush().
+
+  The steps are the bins of a fixed bin TH1 with nBins from xlow to xup,
+  0 underflow and nBins+1 overflow as TAxis::FindFixBin, so fill() gives
+  the same contents as TH1::Fill(x, bit) per frame and channel.
+
+    GEMScanCounter counts(nBins, ah.minTh-0.5, ah.maxTh+0.5);
+    counts.add(vfat.delVT, vfat.lsData, vfat.msData);
+    counts.fill(histos[chan], chan);
+ */
+
+class GEMScanCounter {
+  public:
+    static const int kChannels = 128;
+    static const int kPlanes   = 8;                          // pending counts up to 2^8-1
+    static const unsigned kFlush = (1u << kPlanes) - 1;
+
+    GEMScanCounter(const int nBins_, const double xlow_, const double xup_) :
+      nBins(nBins_ > 0 ? nBins_ : 1), xlow(xlow_), xup(xup_),
+      rows(nBins + 2), counts((nBins + 2)*kChannels, 0), frames(nBins + 2, 0), fired(nBins + 2, 0) {}
+
+    int getNbins() const { return nBins; }
+    double getXlow() const { return xlow; }
+    double getXup()  const { return xup; }
+    //! Scan value at the centre of step b.
+    double center(const int b) const { return xlow + (b - 0.5)*(xup - xlow)/nBins; }
+
+    //! TAxis::FindFixBin of a fixed bin axis.
+    int bin(const double x) const {
+      if(x < xlow) return 0;
+      if(!(x < xup)) return nBins + 1;
+      return 1 + int(nBins*(x - xlow)/(xup - xlow));
+    };
+
+    //! One frame at scan value x, channel c fired when bit c of msData:lsData is set.
+    void add(const double x, const uint64_t lsData, const uint64_t msData){
+      const int b = bin(x);
+      Row& row = rows[b];
+      addWord(row.ls, lsData);
+      addWord(row.ms, msData);
+      frames[b]++;
+      if(lsData | msData) fired[b]++;
+      if(++row.pending == kFlush) flushRow(b);
+    };
+
+    //! Move every pending count into the counter matrix.
+    void flush(){
+      for(int b = 0; b < nBins + 2; ++b) if(rows[b].pending) flushRow(b);
+    };
+
+    //! Add the counts of other, same binning, e.g. of another decoding thread. Flushes other.
+    void merge(GEMScanCounter& other){
+      other.flush();
+      flush();
+      for(size_t i = 0; i < counts.size(); ++i) counts[i] += other.counts[i];
+      for(size_t b = 0; b < frames.size(); ++b){ frames[b] += other.frames[b]; fired[b] += other.fired[b]; }
+    };
+
+    //! Frames of channel chan fired at step b, after flush().
+    uint32_t count(const int b, const int chan) const { return counts[b*kChannels + chan]; }
+    //! Frames at step b.
+    uint64_t getFrames(const int b) const { return frames[b]; }
+    //! Frames at step b with any channel fired.
+    uint64_t getFired(const int b) const { return fired[b]; }
+
+    //! h, booked with the same binning, to the counts of channel chan.
+    void fill(TH1* h, const int chan){
+      flush();
+      for(int b = 0; b < nBins + 2; ++b) setBin(h, b, count(b, chan));
+      h->SetEntries(entries());
+    };
+
+    //! h to the frames with any channel fired, the "allchannels" histogram.
+    void fillAny(TH1* h){
+      for(int b = 0; b < nBins + 2; ++b) setBin(h, b, fired[b]);
+      h->SetEntries(entries());
+    };
+
+  private:
+    struct Row {
+      Row() : pending(0) { for(int k = 0; k < kPlanes; ++k) ls[k] = ms[k] = 0; }
+      uint64_t ls[kPlanes];     // bit slices of channels 0-63
+      uint64_t ms[kPlanes];     // bit slices of channels 64-127
+      unsigned pending;         // frames in the planes
+    };
+
+    //! Add the bits of w to the sliced counters, a ripple carry over the planes.
+    static void addWord(uint64_t* plane, uint64_t w){
+      for(int k = 0; w && k < kPlanes; ++k){
+        const uint64_t carry = plane[k] & w;
+        plane[k] ^= w;
+        w = carry;
+      }
+    };
+
+    void flushRow(const int b){
+      Row& row = rows[b];
+      uint32_t* c = &counts[b*kChannels];
+      for(int k = 0; k < kPlanes; ++k){
+        for(uint64_t w = row.ls[k]; w; w &= w - 1) c[__builtin_ctzll(w)]      += 1u << k;
+        for(uint64_t w = row.ms[k]; w; w &= w - 1) c[64 + __builtin_ctzll(w)] += 1u << k;
+        row.ls[k] = row.ms[k] = 0;
+      }
+      row.pending = 0;
+    };
+
+    //! Content n, error sqrt(n): the sum of weights and squared weights of n fills with weight 1.
+    static void setBin(TH1* h, const int b, const double n){
+      h->SetBinContent(b, n);
+      h->SetBinError(b, std::sqrt(n));
+    };
+
+    double entries() const {
+      double n = 0;
+      for(int b = 0; b < nBins + 2; ++b) n += frames[b];
+      return n;
+    };
+
+    int    nBins;
+    double xlow;
+    double xup;
+    std::vector<Row>      rows;
+    std::vector<uint32_t> counts;   // (nBins+2) x 128, step major
+    std::vector<uint64_t> frames;
+    std::vector<uint64_t> fired;
+};
+
+//! Threshold scan counts of every VFAT2 chip in the file, and of all of them together.
+/*!
+  \brief GEMScanChips
+  A chip gets its GEMScanCounter on its first frame with valid 1110 control
+  bits, about 0.7 kB per threshold step, the frames of all chips are counted
+  in all as well. ids() gives the chips by ChipID, whatever the order they
+  were seen or merged in.
+
+    GEMScanChips counts(nBins, ah.minTh-0.5, ah.maxTh+0.5);
+    counts.add(vfat.ChipID, vfat.delVT, vfat.lsData, vfat.msData);
+    counts.all.fill(histos[chan], chan);
+ */
+
+class GEMScanChips {
+  public:
+    GEMScanChips(const int nBins, const double xlow, const double xup) :
+      all(nBins, xlow, xup), index(0x1000, -1) {}
+
+    //! One frame, ChipID the 16 bit word with the 1110 control bits.
+    void add(const uint16_t ChipID, const double x, const uint64_t lsData, const uint64_t msData){
+      all.add(x, lsData, msData);
+      if(GEMBits::VFAT::Control::get(ChipID) == GEMBits::VFAT::k1110) get(GEMBits::VFAT::ChipID::get(ChipID)).add(x, lsData, msData);
+    };
+
+    //! The counts of chip id:12, created empty on its first use.
+    GEMScanCounter& get(const uint16_t id){
+      if(index[id] < 0){
+        index[id] = chips.size();
+        chips.push_back(Chip(id, GEMScanCounter(all.getNbins(), all.getXlow(), all.getXup())));
+      }
+      return chips[index[id]].counts;
+    };
+
+    //! Add the counts of other, same binning, chip by chip. Flushes other.
+    void merge(GEMScanChips& other){
+      all.merge(other.all);
+      for(size_t i = 0; i < other.chips.size(); ++i) get(other.chips[i].id).merge(other.chips[i].counts);
+    };
+
+    size_t size() const { return chips.size(); }
+
+    //! The ChipIDs seen, ascending.
+    std::vector<uint16_t> ids() const {
+      std::vector<uint16_t> v;
+      for(size_t i = 0; i < chips.size(); ++i) v.push_back(chips[i].id);
+      std::sort(v.begin(), v.end());
+      return v;
+    };
+
+    GEMScanCounter all;
+
+  private:
+    struct Chip {
+      Chip(const uint16_t id_, const GEMScanCounter& counts_) : id(id_), counts(counts_) {}
+      uint16_t       id;
+      GEMScanCounter counts;
+    };
+
+    std::vector<int32_t> index;   // ChipID:12 to chips, -1 not seen
+    std::deque<Chip>     chips;   // stable addresses, get() references stay valid
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef GEM_ThreadCounts
+#define GEM_ThreadCounts
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMThreadCounts                                                      //
+//                                                                      //
+// One private set of DQM counters per decoding thread, summed in       //
+// thread order for snapshots and at the end of the run                 //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <mutex>
+#include <vector>
+
+//! Thread-local counters with a deterministic merge.
+/*!
+  \brief GEMThreadCounts
+  Counts is a copyable counter set with merge(Counts& other), which adds
+  other into it and may flush other's pending counts. Thread i adds into
+  local(i) while it holds lock(i), nobody else takes that lock except
+  merge(), so the locks are never contended while decoding.
+
+  merge() starts from the prototype and adds the threads in index order.
+  All counts are integers, so the result is the same bit for bit for any
+  number of threads and any interleaving: the histograms are set from the
+  sums, not filled in thread order.
+
+    GEMThreadCounts<GEMScanCounter> threadCounts(nJobs, counts);
+    // thread i
+    std::lock_guard<std::mutex> lock(threadCounts.lock(i));
+    threadCounts.local(i).add(vfat.delVT, vfat.lsData, vfat.msData);
+    // snapshot, end of run
+    threadCounts.merge(counts);
+ */
+
+template <class Counts>
+class GEMThreadCounts {
+  public:
+    GEMThreadCounts(const unsigned nThreads, const Counts& prototype_) :
+      prototype(prototype_), parts(nThreads ? nThreads : 1, prototype_), locks(parts.size()) {}
+
+    unsigned threads() const { return parts.size(); }
+
+    //! The counters of thread i, only while holding lock(i).
+    Counts& local(const unsigned i){ return parts[i]; }
+    std::mutex& lock(const unsigned i){ return locks[i]; }
+
+    //! The counters of thread i back to the prototype, e.g. for a part which must not count.
+    void reset(const unsigned i){
+      std::lock_guard<std::mutex> guard(locks[i]);
+      parts[i] = prototype;
+    };
+
+    //! total = prototype + the counters of thread 0, 1, ...
+    void merge(Counts& total){
+      total = prototype;
+      for(size_t i = 0; i < parts.size(); ++i){
+        std::lock_guard<std::mutex> guard(locks[i]);
+        total.merge(parts[i]);
+      }
+    };
+
+  private:
+    Counts                  prototype;
+    std::vector<Counts>     parts;
+    std::vector<std::mutex> locks;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef GEM_TreeSettings
+#define GEM_TreeSettings
+
+//////////////////////////////////////////////////////////////////////////
+//                                                                      //
+// GEMTreeSettings                                                      //
+//                                                                      //
+// Output settings of the GEM event trees: basket size, auto-flush      //
+// cluster size, split level and compression of the ROOT file           //
+//                                                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <TFile.h>
+#include <TTree.h>
+
+//! TTree and TFile output settings.
+/*!
+  \brief GEMTreeSettings
+  the defaults are the ROOT defaults, parse() takes the options
+
+    --basket N          basket size of every branch, bytes
+    --autoflush N       cluster size, N > 0 entries, N < 0 bytes, 0 off
+    --split N           split level of the GEMEvents branch
+    --algorithm NAME    zlib, lzma, lz4 or zstd
+    --level N           compression level, 0 none ... 9
+    --compression N     100*algorithm + level, as gem-re-write --compression
+
+  lz4 with a low level is the choice for online writing, zstd or lzma with
+  a high level for the archive. zstd needs ROOT 6.20 or later.
+ */
+
+class GEMTreeSettings {
+  public:
+    // ROOT::RCompressionSetting::EAlgorithm
+    enum Algorithm { kUseGlobal = 0, kZLIB = 1, kLZMA = 2, kOldCompression = 3, kLZ4 = 4, kZSTD = 5 };
+
+    GEMTreeSettings() : basketSize(32000), autoFlush(-30000000), splitLevel(99), algorithm(kZLIB), level(1) {}
+
+    int      basketSize;
+    Long64_t autoFlush;
+    int      splitLevel;
+    int      algorithm;
+    int      level;
+
+    int  compression() const { return 100*algorithm + level; }
+    void setCompression(int settings){ algorithm = settings/100; level = settings%100; }
+
+    //! Algorithm code from its name, -1 if unknown.
+    static int algorithmCode(const std::string& name){
+      if(name == "zlib" || name == "ZLIB") return kZLIB;
+      if(name == "lzma" || name == "LZMA") return kLZMA;
+      if(name == "lz4"  || name == "LZ4")  return kLZ4;
+      if(name == "zstd" || name == "ZSTD") return kZSTD;
+      return -1;
+    };
+    static std::string algorithmName(int code){
+      switch(code){
+        case kZLIB: return "zlib";
+        case kLZMA: return "lzma";
+        case kLZ4:  return "lz4";
+        case kZSTD: return "zstd";
+        default:    return "global";
+      }
+    };
+
+    //! Take the option at argv[i] and its value, false if it is not one of ours.
+    bool parse(int& i, int argc, char** argv){
+      std::string arg = argv[i];
+      if(i+1 >= argc) return(false);
+      if     (arg == "--basket")      basketSize = atoi(argv[++i]);
+      else if(arg == "--autoflush")   autoFlush  = atoll(argv[++i]);
+      else if(arg == "--split")       splitLevel = atoi(argv[++i]);
+      else if(arg == "--level")       level      = atoi(argv[++i]);
+      else if(arg == "--compression") setCompression(atoi(argv[++i]));
+      else if(arg == "--algorithm"){
+        int code = algorithmCode(argv[++i]);
+        if(code < 0) std::cout << "Unknown compression algorithm " << argv[i] << ", keeping " << algorithmName(algorithm) << std::endl;
+        else         algorithm = code;
+      }
+      else return(false);
+      return(true);
+    };
+
+    //! Before the trees are created, their branches take the compression of the file.
+    void apply(TFile* file) const { file->SetCompressionSettings(compression()); }
+
+    void apply(TTree& tree) const { tree.SetAutoFlush(autoFlush); }
+
+    std::string describe() const {
+      std::ostringstream s;
+      s << algorithmName(algorithm) << "-" << level << " basket " << basketSize
+        << " autoflush " << autoFlush << " split " << splitLevel;
+      return s.str();
+    };
+};
+
+#endif
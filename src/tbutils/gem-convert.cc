@@ -0,0 +1,318 @@
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <cstdint>
+#include <chrono>
+
+#include <sys/stat.h>
+
+#include "GEMGEBRecord.h"
+#include "GEMDataWriter.h"
+#include "GEMIndexedFile.h"
+#include "GEMBlockFile.h"
+#include "GEMBitFields.h"
+/**
+* ... Bulk converter of the hex text GEM data files into the binary formats ...
+*/
+
+/*! \file */
+/*!
+  Converts DataParker.dat (gem-reading.cc) text files into the binary, indexed
+  or block compressed GEB formats.
+
+  Records are converted in batches of about 1 MB, each batch is decoded again
+  from its binary image and compared field by field with the text input before
+  it is written. After the output file is closed it is read back with its own
+  reader and the CRC-32 of the decoded records is compared with the one of the
+  written records. MB/s of text input and events/s are reported per file.
+
+  gem-convert [--format DataParker] [--type Binary|Indexed|Block]
+              [--compression N] [--out file] input.dat [input2.dat ...]
+
+  A token which does not fit its field, e.g. five hex digits for BC, is not
+  narrowed: the record is rejected as corrupted and the file fails, the records
+  in front of it are still converted. scripts/gem_convert_test.sh checks this.
+
+  The binary record carries BC, EC, ChipID, lsData, msData and crc of every
+  VFAT2 frame. ThresholdScan.dat (thldread.cc) is refused: its scan header and
+  the bxExp, bxNum and delVT of every frame are not part of the record, so the
+  conversion could not be lossless.
+*/
+
+using namespace std;
+
+//! Binary image of the GEB records.
+/*!
+  \brief GEMOnline
+  writes GEMGEBRecord records in the layout of GEMBinaryReader and compares
+  them with their decoded image
+*/
+
+class GEMOnline {
+  public:
+      typedef GEMGEBRecord::VFATData VFATData;
+      typedef GEMGEBRecord::GEBData  GEBData;
+
+      //! Binary GEB record, the layout of GEMBinaryReader.
+      static void writeGEBBinary(GEMDataWriter& outf, const GEBData& geb){
+        outf.writeBinary(geb.header);
+        for(size_t i = 0; i < geb.vfats.size(); ++i){
+          const VFATData& vfat = geb.vfats[i];
+          outf.writeBinary(vfat.BC);
+          outf.writeBinary(vfat.EC);
+          outf.writeBinary(vfat.ChipID);
+          outf.writeBinary(vfat.lsData);
+          outf.writeBinary(vfat.msData);
+          outf.writeBinary(vfat.crc);
+        }
+        outf.writeBinary(geb.trailer);
+      };
+
+      //! Decode one binary GEB record and compare it with the text input.
+      static bool verifyGEB(GEMBinaryReader& binf, const GEBData& geb){
+        uint64_t header, trailer;
+        if(!binf.readWord(header) || header != geb.header) return(false);
+        if(GEMBits::GEBHeader::SumVFAT::get(header) != geb.vfats.size()) return(false);
+        for(size_t i = 0; i < geb.vfats.size(); ++i){
+          GEMBinaryReader::VFATRecord r;
+          if(!binf.nextVFAT(r)) return(false);
+          const VFATData& vfat = geb.vfats[i];
+          if(r.BC()     != vfat.BC     || r.EC()     != vfat.EC     || r.ChipID() != vfat.ChipID ||
+             r.lsData() != vfat.lsData || r.msData() != vfat.msData || r.crc()    != vfat.crc) return(false);
+        }
+        return(binf.readWord(trailer) && trailer == geb.trailer);
+      };
+};
+
+//! Output file of one conversion, binary, indexed or block compressed.
+/*!
+  \brief GEMConvertOutput
+  takes verified batches of binary GEB records and keeps the CRC-32 of all
+  record bytes, verifyFile() reads the closed file back and compares.
+ */
+
+class GEMConvertOutput {
+  public:
+    GEMConvertOutput(const string& type_, int compression) : type(type_), crc(0), records(0), bytes(0) {
+      blockf.setCompression(compression);
+    };
+
+    bool open(const string& file_){
+      file = file_; crc = 0; records = 0; bytes = 0;
+      if(type == "Indexed") return(indexf.open(file));
+      if(type == "Block")   return(blockf.open(file));
+      return(binf.open(file, false));
+    };
+
+    //! One GEB record, already verified, nVFAT frames, EC/BC of the first one for the index.
+    void addRecord(const char* data, size_t n, uint64_t event, uint16_t EC, uint16_t BC, uint16_t ChamID, uint64_t nVFAT){
+      crc = GEMBlock::crc32(data, n, crc);
+      records++; bytes += n;
+      if(type == "Indexed"){
+        indexf.addEntry(event, EC, BC, ChamID, nVFAT);
+        indexf.stream().write(data, n);
+      } else if(type == "Block"){
+        blockf.stream().write(data, n);
+        blockf.endRecord();
+      } else {
+        binf.write(data, n);
+      }
+    };
+
+    bool close(){
+      if(type == "Indexed") return(indexf.close());
+      if(type == "Block")   return(blockf.close());
+      return(binf.close());
+    };
+
+    uint64_t nRecords() const { return records; }
+
+    //! Read the closed file with its reader, the records must have the CRC-32 of the written ones.
+    bool verifyFile(){
+      uint32_t c = 0;
+      uint64_t n = 0, nrec = 0;
+      if(type == "Block"){
+        GEMBlockReader r;
+        if(!r.open(file) || r.skippedBytes()) return(false);
+        std::vector<unsigned char> buffer;
+        for(size_t i = 0; i < r.nBlocks(); ++i){
+          if(!r.decodeBlock(i, buffer)) return(false);
+          if(!buffer.empty()) c = GEMBlock::crc32(&buffer[0], buffer.size(), c);
+          n += buffer.size(); nrec += r.block(i).nRecords;
+        }
+        return(c == crc && n == bytes && nrec == records);
+      }
+      GEMIndexedReader idx;
+      GEMBinaryReader  raw;
+      GEMBinaryReader* in = &raw;
+      if(type == "Indexed"){
+        if(!idx.open(file) || idx.entries() != records) return(false);
+        in = &idx.stream();
+      } else if(!raw.open(file)) return(false);
+      size_t begin = in->tell(), end = in->getEnd();
+      if(end > begin) c = GEMBlock::crc32(in->data() + begin, end - begin);
+      return(c == crc && end - begin == bytes);
+    };
+
+  private:
+    string           type;
+    string           file;
+    GEMDataWriter    binf;
+    GEMIndexedWriter indexf;
+    GEMBlockWriter   blockf;
+    uint32_t         crc;
+    uint64_t         records;
+    uint64_t         bytes;
+};
+
+//! Output file name: the input with the extension of the output type.
+static string outputName(const string& input, const string& type){
+  string ext = (type == "Indexed") ? ".gidx" : (type == "Block") ? ".gblk" : ".bin";
+  size_t dot = input.rfind('.');
+  size_t slash = input.rfind('/');
+  if(dot == string::npos || (slash != string::npos && dot < slash)) return(input + ext);
+  return(input.substr(0, dot) + ext);
+}
+
+//! Size of a file in bytes, 0 if it can not be read.
+static uint64_t fileSize(const string& file){
+  struct stat st;
+  return (stat(file.c_str(), &st) == 0) ? st.st_size : 0;
+}
+
+//! Convert one file, returns false if it can not be read, written or verified.
+static bool convert(const string& input, const string& output, GEMConvertOutput& out){
+  GEMHexReader inpf;
+  if(!inpf.open(input)) {
+    cout << "\nThe file: " << input << " is missing.\n" << endl;
+    return(false);
+  };
+  if(!out.open(output)) {
+    cout << "\nThe file: " << output << " can not be opened for writing.\n" << endl;
+    return(false);
+  };
+
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+  const size_t kBatch = 1 << 20;
+  std::vector<GEMOnline::GEBData> batch;
+  GEMDataWriter image;
+  image.openMemory();
+  uint64_t event = 0, nVFAT = 0;
+  bool ok = true, more = true, truncated = false;
+
+  while(more && ok){
+    // read and encode a batch of records
+    size_t n = 0;
+    image.discard();
+    std::vector<size_t> offsets;
+    while(image.bufferedSize() < kBatch){
+      if(n == batch.size()) batch.push_back(GEMOnline::GEBData());
+      if(!inpf.good()){ more = false; break; }
+      if(!GEMGEBRecord::readGEB(inpf, batch[n])){
+        cout << "\nThe file: " << input << " is truncated or corrupted at byte " << inpf.tell() << ".\n" << endl;
+        truncated = true;   // the complete records in front are still converted
+        more = false;
+        break;
+      }
+      offsets.push_back(image.bufferedSize());
+      GEMOnline::writeGEBBinary(image, batch[n]);
+      n++;
+    }
+    offsets.push_back(image.bufferedSize());
+
+    // decode the binary image again and compare before anything is written
+    GEMBinaryReader binf;
+    binf.attach(image.buffered(), image.bufferedSize());
+    for(size_t i = 0; i < n; ++i){
+      if(!GEMOnline::verifyGEB(binf, batch[i])){
+        cout << "\nRound trip mismatch in GEB record " << event + i << " of " << input << ".\n" << endl;
+        ok = false;
+        break;
+      }
+    }
+    if(!ok) break;
+
+    for(size_t i = 0; i < n; ++i, ++event){
+      const GEMOnline::GEBData& geb = batch[i];
+      uint16_t EC = 0, BC = 0;
+      if(!geb.vfats.empty()){
+        EC = GEMBits::VFAT::EC::get(geb.vfats[0].EC);
+        BC = GEMBits::VFAT::BC::get(geb.vfats[0].BC);
+      }
+      out.addRecord(image.buffered() + offsets[i], offsets[i+1] - offsets[i], event, EC, BC,
+                    GEMBits::GEBHeader::ChamID::get(geb.header), geb.vfats.size());
+      nVFAT += geb.vfats.size();
+    }
+  }
+  if(truncated) ok = false;
+
+  if(!out.close()) {
+    cout << "\nThe file: " << output << " could not be written.\n" << endl;
+    ok = false;
+  };
+  if(ok && !out.verifyFile()) {
+    cout << "\nThe file: " << output << " does not read back as written.\n" << endl;
+    ok = false;
+  };
+
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  double MB  = fileSize(input)/1.e6;
+  if(sec <= 0) sec = 1.e-9;
+  cout << input << " -> " << output << (ok ? " verified" : " FAILED") << endl
+       << "  " << out.nRecords() << " GEB records, " << nVFAT << " VFAT2 frames, "
+       << setprecision(3) << MB << " MB text -> " << fileSize(output)/1.e6 << " MB" << endl
+       << "  " << sec << " s, " << MB/sec << " MB/s, " << out.nRecords()/sec << " events/s, "
+       << nVFAT/sec << " frames/s" << endl;
+  return(ok);
+}
+
+//! main function.
+/*!
+C++ any documents
+*/
+
+int main(int argc, char** argv)
+{
+  string format = "DataParker";   // --format DataParker, ThresholdScan is refused
+  string type   = "Binary";       // --type Binary|Indexed|Block, the gem-re-write output types
+  string out;                     // --out file : one input only, default input name with .bin/.gidx/.gblk
+  int compression = GEMBlock::kDefaultComp; // --compression N : Block, 100*algorithm + level
+  vector<string> files;
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if      (arg == "--format" && i+1<argc) format = argv[++i];
+    else if (arg == "--type"   && i+1<argc) type   = argv[++i];
+    else if (arg == "--out"    && i+1<argc) out    = argv[++i];
+    else if (arg == "--compression" && i+1<argc) compression = atoi(argv[++i]);
+    else if (arg.size() && arg[0]!='-')     files.push_back(arg);
+    else {
+      cout << "unknown option " << arg << endl;
+      return 1;
+    }
+  }
+  if(format == "ThresholdScan") {
+    cout << "ThresholdScan: the scan header, bxExp, bxNum and delVT are not part of the binary record,\n"
+         << "the threshold scan files stay text, read them with thldread" << endl;
+    return 1;
+  }
+  if(files.empty() || format != "DataParker" ||
+     (type != "Binary" && type != "Indexed" && type != "Block") || (!out.empty() && files.size() > 1)) {
+    cout << "usage: gem-convert [--format DataParker] [--type Binary|Indexed|Block]\n"
+         << "                   [--compression N] [--out file] input.dat [input2.dat ...]" << endl;
+    return 1;
+  }
+
+  GEMConvertOutput output(type, compression);
+  int failed = 0;
+  for(size_t i = 0; i < files.size(); ++i){
+    string name = out.empty() ? outputName(files[i], type) : out;
+    if(!convert(files[i], name, output)) failed++;
+  }
+  if(failed) cout << failed << " of " << files.size() << " files failed" << endl;
+  return(failed ? 2 : 0);
+}
@@ -0,0 +1,116 @@
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <vector>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include <iterator>
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include "Event.h"
+#include "GEMEventLookup.h"
+/**
+* ... GEMtree point queries ...
+*/
+
+/*! \file */
+/*!
+  Prints the GEMtree events of one LV1ID, one (LV1ID, BXID) pair or one
+  chamber from a DQMlight.root written by gem-reading. Only the matching
+  entries are read, through the TTreeIndex on (LV1ID, BXID) of AMC input and
+  the GEMindex/ChamID_<id> entry lists.
+
+  gem-lookup [--lv1id N [--bxid N]] [--chamber ID] [--print N] [file]
+
+  With --lv1id and --chamber both given only the events of that LV1ID which
+  have a GEB of the chamber are printed. Numbers may be given in hex, 0x5a3.
+*/
+
+using namespace std;
+
+//! One line per event, the ChamIDs of its GEBs and their number of VFAT2 frames.
+static void printEvent(const Long64_t entry, const Event& ev){
+  cout << "entry " << setw(9) << entry << "  LV1ID " << setw(8) << ev.GetLV1ID() << "  BXID " << setw(4) << ev.GetBXID()
+       << "  GEBs " << ev.GetNGEBs() << " :";
+  const vector<GEBdata>& gebs = ev.GetGEBs();
+  for(size_t i = 0; i < gebs.size(); ++i)
+    cout << " 0x" << hex << gebs[i].getChamID() << dec << "/" << gebs[i].getVFATs().size();
+  cout << endl;
+}
+
+int main(int argc, char** argv)
+{
+  long lv1id   = -1;            // --lv1id N  : events of this LV1ID, needs AMC input
+  long bxid    = -1;            // --bxid N   : with --lv1id, the one event of this LV1ID and BXID
+  long chamber = -1;            // --chamber ID : events with a GEB of this chamber
+  long nPrint  = 20;            // --print N  : print the first N events found, -1 all
+  string file  = "DQMlight.root";
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if      (arg == "--lv1id"   && i+1<argc) lv1id   = strtol(argv[++i], 0, 0);
+    else if (arg == "--bxid"    && i+1<argc) bxid    = strtol(argv[++i], 0, 0);
+    else if (arg == "--chamber" && i+1<argc) chamber = strtol(argv[++i], 0, 0);
+    else if (arg == "--print"   && i+1<argc) nPrint  = strtol(argv[++i], 0, 0);
+    else if (arg.size() && arg[0]!='-')      file    = arg;
+    else {
+      cout << "unknown option " << arg << endl;
+      return 1;
+    }
+  }
+  if((lv1id < 0 && chamber < 0) || (bxid >= 0 && lv1id < 0)) {
+    cout << "usage: gem-lookup [--lv1id N [--bxid N]] [--chamber ID] [--print N] [file]" << endl;
+    return 1;
+  }
+
+  TFile* hfile = TFile::Open(file.c_str());
+  GEMEventLookup lookup(hfile);
+  if(!lookup.good()) {
+    cout << "\nThe file: " << file << " has no GEMtree.\n" << endl;
+    return 1;
+  }
+  if(lv1id >= 0 && !lookup.indexed()) {
+    cout << "\nGEMtree of " << file << " has no LV1ID index, it is built for gem-reading --amc input only.\n" << endl;
+    return 1;
+  }
+
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+  // the candidates from the index, the chamber list or both
+  vector<Long64_t> entries;
+  if(lv1id >= 0 && bxid >= 0){
+    Long64_t entry = lookup.find(lv1id, bxid);
+    if(entry >= 0) entries.push_back(entry);
+  }
+  else if(lv1id >= 0) entries = lookup.findLV1ID(lv1id);
+  if(chamber >= 0){
+    vector<Long64_t> inChamber = lookup.findChamber(chamber);
+    if(lv1id < 0) entries.swap(inChamber);
+    else {
+      vector<Long64_t> both;
+      sort(entries.begin(), entries.end());
+      set_intersection(entries.begin(), entries.end(), inChamber.begin(), inChamber.end(), back_inserter(both));
+      entries.swap(both);
+    }
+  }
+  std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+  size_t nRead = 0;
+  for(size_t i = 0; i < entries.size() && (nPrint < 0 || (long)i < nPrint); ++i){
+    if(!lookup.read(entries[i])) continue;
+    printEvent(entries[i], *lookup.event());
+    nRead++;
+  }
+  std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+  cout << entries.size() << " of " << lookup.getTree()->GetEntries() << " events match, lookup "
+       << setprecision(3) << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms, "
+       << nRead << " read in " << std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms" << endl;
+
+  hfile->Close();
+  return 0;
+}
@@ -25,6 +25,11 @@
 #include <TApplication.h>
 #include <TString.h>
 
+#include "GEMDataWriter.h"
+#include "GEMIndexedFile.h"
+#include "GEMBlockFile.h"
+#include "GEMBitFields.h"
+
 /**
 * ... Threshold Scan ROOT based application, could be used for analisys of XDAQ GEM data ...
 */
@@ -64,8 +69,11 @@ using namespace std;
 
 int event_ = 0;
 int GEBDataEvent = 0;
-std::string outputType_ = "Hex";
+std::string outputType_ = "Hex";   // "Hex", "Binary", "Indexed" or "Block"
 std::string outFileName_ = "DataParkerThreshold.dat";
+GEMDataWriter outFile_;     // kept open for the whole conversion, see main()
+GEMIndexedWriter outIndexed_; // outputType_ "Indexed", binary records plus event offset table
+GEMBlockWriter outBlock_;     // outputType_ "Block", binary records in compressed blocks
 
 class GEMOnline {
   public:
@@ -154,22 +162,22 @@ class GEMOnline {
         if( event<0) return(false);
 	  cout << "\nReceived VFAT data word: event " << event << endl;
   
-          uint8_t   b1010 = (0xf000 & vfat.BC) >> 12;
-          show4bits(b1010); cout << " BC     0x" << hex << (0x0fff & vfat.BC) << dec << endl;
+          uint8_t   b1010 = GEMBits::VFAT::Control::get(vfat.BC);
+          show4bits(b1010); cout << " BC     0x" << hex << GEMBits::VFAT::BC::get(vfat.BC) << dec << endl;
   
-          uint8_t   b1100 = (0xf000 & vfat.EC) >> 12;
-          uint16_t   EC   = (0x0ff0 & vfat.EC) >> 4;
-          uint8_t   Flag  = (0x000f & vfat.EC);
+          uint8_t   b1100 = GEMBits::VFAT::Control::get(vfat.EC);
+          uint16_t   EC   = GEMBits::VFAT::EC::get(vfat.EC);
+          uint8_t   Flag  = GEMBits::VFAT::Flag::get(vfat.EC);
           show4bits(b1100); cout << " EC     0x" << hex << EC << dec << endl; 
           show4bits(Flag);  cout << " Flags " << endl;
   
-          uint8_t   b1110 = (0xf000 & vfat.ChipID) >> 12;
-          uint16_t ChipID = (0x0fff & vfat.ChipID);
+          uint8_t   b1110 = GEMBits::VFAT::Control::get(vfat.ChipID);
+          uint16_t ChipID = GEMBits::VFAT::ChipID::get(vfat.ChipID);
           show4bits(b1110); cout << " ChipID 0x" << hex << ChipID << dec << " " << endl;
   
           cout << "     bxExp  0x" << std::setfill('0') << std::setw(4) << hex << vfat.bxExp << dec << " " << endl;
-  	  cout << "     bxNum  0x" << std::setfill('0') << std::setw(2) << hex << ((0xff00 & vfat.bxNum) >> 8) << dec << endl;
-  	  cout << "     SBit   0x" << std::setfill('0') << std::setw(2) << hex <<  (0x00ff & vfat.bxNum)       << dec << endl;
+  	  cout << "     bxNum  0x" << std::setfill('0') << std::setw(2) << hex << GEMBits::VFAT::BxNum::get(vfat.bxNum) << dec << endl;
+  	  cout << "     SBit   0x" << std::setfill('0') << std::setw(2) << hex <<  GEMBits::VFAT::SBit::get(vfat.bxNum)       << dec << endl;
           cout << " <127:64>:: 0x" << std::setfill('0') << std::setw(8) << hex << vfat.msData << dec << endl;
           cout << " <63:0>  :: 0x" << std::setfill('0') << std::setw(8) << hex << vfat.lsData << dec << endl;
           cout << "     crc    0x" << hex << vfat.crc << dec << endl;
@@ -187,9 +195,9 @@ class GEMOnline {
       bool PrintChipID(int event, const VFATData& vfat){
         if( event<0 ) return(false);
           cout << "\nevent " << event << endl;
-          uint8_t bitsE = ((vfat.ChipID&0xF000)>>12);
+          uint8_t bitsE = GEMBits::VFAT::Control::get(vfat.ChipID);
           showbits(bitsE);
-          cout << hex << "1110 0x0" << ((vfat.ChipID&0xF000)>>12) << " ChipID 0x" << (vfat.ChipID&0x0FFF) << dec << endl;
+          cout << hex << "1110 0x0" << GEMBits::VFAT::Control::get(vfat.ChipID) << " ChipID 0x" << GEMBits::VFAT::ChipID::get(vfat.ChipID) << dec << endl;
       };
     
       //! Read 1-128 channels data
@@ -249,77 +257,77 @@ class GEMOnline {
        *
        */
 
-      static bool writeGEBheader(string file, int event, const GEBData& geb){
-        ofstream outf(file.c_str(), ios_base::app );
+      static bool writeGEBheader(GEMDataWriter& outf, int event, const GEBData& geb){
         if( event<0) return(false);
         if(!outf.is_open()) return(false);
-          outf << hex << geb.header << dec << endl;
-          outf.close();
-        return(true);
+        return(outf.writeHex(geb.header));
       };	  
 
-      static bool writeGEBtrailer(string file, int event, const GEBData& geb){
-        ofstream outf(file.c_str(), ios_base::app );
+      static bool writeGEBtrailer(GEMDataWriter& outf, int event, const GEBData& geb){
         if( event<0) return(false);
         if(!outf.is_open()) return(false);
-          outf << hex << geb.trailer << dec << endl;
-          outf.close();
-        return(true);
+        return(outf.writeHex(geb.trailer));
       };	  
 
-      static bool writeVFATdata(string file, int event, const VFATData& vfat){
-        ofstream outf(file.c_str(), ios_base::app );
+      static bool writeVFATdata(GEMDataWriter& outf, int event, const VFATData& vfat){
         if( event<0) return(false);
         if(!outf.is_open()) return(false);
-          outf << hex << vfat.BC << dec << endl;
-          outf << hex << vfat.EC << dec << endl;
-          outf << hex << vfat.ChipID << dec << endl;
-          outf << hex << vfat.lsData << dec << endl;
-          outf << hex << vfat.msData << dec << endl;
-          outf << hex << vfat.crc << dec << endl;
-          outf.close();
-        return(true);
+          outf.writeHex(vfat.BC);
+          outf.writeHex(vfat.EC);
+          outf.writeHex(vfat.ChipID);
+          outf.writeHex(vfat.lsData);
+          outf.writeHex(vfat.msData);
+          outf.writeHex(vfat.crc);
+        return(!outf.fail());
       };	  
 
-      static bool writeGEBheaderBinary(string file, int event, const GEBData& geb){
-        ofstream outf(file.c_str(), ios_base::app | ios::binary );
+      static bool writeGEBheaderBinary(GEMDataWriter& outf, int event, const GEBData& geb){
         if( event<0) return(false);
         if(!outf.is_open()) return(false);
-  	  outf.write( (char*)&geb.header, sizeof(geb.header));
-          outf.close();
-        return(true);
+        return(outf.writeBinary(geb.header));
       };
 	  
-      static bool writeGEBtrailerBinary(string file, int event, const GEBData& geb){
-        ofstream outf(file.c_str(), ios_base::app | ios::binary );
+      static bool writeGEBtrailerBinary(GEMDataWriter& outf, int event, const GEBData& geb){
         if( event<0) return(false);
         if(!outf.is_open()) return(false);
-  	  outf.write( (char*)&geb.trailer, sizeof(geb.trailer));
-          outf.close();
-        return(true);
+        return(outf.writeBinary(geb.trailer));
       };
 
-      static bool writeVFATdataBinary(string file, int event, const VFATData& vfat){
-        ofstream outf(file.c_str(), ios_base::app | ios::binary );
+      static bool writeVFATdataBinary(GEMDataWriter& outf, int event, const VFATData& vfat){
         if( event<0) return(false);
         if(!outf.is_open()) return(false);
-  	  outf.write( (char*)&vfat.BC, sizeof(vfat.BC));
-  	  outf.write( (char*)&vfat.EC, sizeof(vfat.EC));
-  	  outf.write( (char*)&vfat.ChipID, sizeof(vfat.ChipID));
-  	  outf.write( (char*)&vfat.lsData, sizeof(vfat.lsData));  
-  	  outf.write( (char*)&vfat.msData, sizeof(vfat.msData));
-  	  outf.write( (char*)&vfat.crc, sizeof(vfat.crc));
-          outf.close();
-        return(true);
+  	  outf.writeBinary(vfat.BC);
+  	  outf.writeBinary(vfat.EC);
+  	  outf.writeBinary(vfat.ChipID);
+  	  outf.writeBinary(vfat.lsData);  
+  	  outf.writeBinary(vfat.msData);
+  	  outf.writeBinary(vfat.crc);
+        return(!outf.fail());
       };	  
 
-      static void writeGEMevent(GEMData& gem, GEBData& geb, VFATData& vfat)
+      //! Write one GEB record: header, all geb.vfats and trailer, through outFile_, outIndexed_ or outBlock_
+      /*!
+        the frames of the first ieventPrint events are printed as well
+       */
+      static void writeGEMevent(GEMData& gem, GEBData& geb, VFATData& vfat, int ieventPrint)
       {
+        GEMDataWriter& outf = (outputType_ == "Indexed") ? outIndexed_.stream() :
+                              (outputType_ == "Block")   ? outBlock_.stream()   : outFile_;
+
+        if(outputType_ == "Indexed"){
+          uint16_t EC = 0, BC = 0;
+          if(!geb.vfats.empty()){
+            EC = GEMBits::VFAT::EC::get(geb.vfats[0].EC);
+            BC = GEMBits::VFAT::BC::get(geb.vfats[0].BC);
+          }
+          outIndexed_.addEntry(event_, EC, BC, GEMBits::GEBHeader::ChamID::get(geb.header), geb.vfats.size());
+        }
+
         // GEB data level
         if(outputType_ == "Hex"){
-          writeGEBheader (outFileName_, event_, geb);
+          writeGEBheader (outf, event_, geb);
         } else {
-          writeGEBheaderBinary (outFileName_, event_, geb);
+          writeGEBheaderBinary (outf, event_, geb);
         } 
           
         int nChip=0;
@@ -333,18 +341,19 @@ class GEMOnline {
           vfat.crc    = (*iVFAT).crc;
             
           if(outputType_ == "Hex"){
-            writeVFATdata (outFileName_, nChip, vfat); 
+            writeVFATdata (outf, nChip, vfat); 
           } else {
-            writeVFATdataBinary (outFileName_, nChip, vfat);
+            writeVFATdataBinary (outf, nChip, vfat);
           } 
-          printVFATdataBits(nChip, vfat);
+          if(event_ < ieventPrint) printVFATdataBits(nChip, vfat);
         } //end of VFAT
       
         if(outputType_ == "Hex"){
-          writeGEBtrailer (outFileName_, event_, geb);
+          writeGEBtrailer (outf, event_, geb);
         } else {
-          writeGEBtrailerBinary (outFileName_, event_, geb);
+          writeGEBtrailerBinary (outf, event_, geb);
         } 
+        if(outputType_ == "Block") outBlock_.endRecord();
         /* } // end of GEB */
       }
       
@@ -368,7 +377,21 @@ TFile* thldread(Int_t get=0)
 #endif
 { cout<<"---> Main()"<<endl;
 
+  string file="ThresholdScan.dat";
+
 #ifndef __CINT__
+  // our own options, everything else goes to TApplication
+  int appArgc = 1;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if      (arg == "--type" && i+1<argc) outputType_  = argv[++i];
+    else if (arg == "--out"  && i+1<argc) outFileName_ = argv[++i];
+    else if (arg == "--compression" && i+1<argc) outBlock_.setCompression(atoi(argv[++i])); // 100*algorithm + level
+    else if (arg.size() && arg[0]!='-')   file = arg;
+    else                                  argv[appArgc++] = argv[i];
+  }
+  argc = appArgc;
+
   TApplication App("App", &argc, argv);
 #endif
 
@@ -379,7 +402,6 @@ TFile* thldread(Int_t get=0)
   GEMOnline::GEMData   gem;
 
   int ieventPrint = 30;
-  string file="ThresholdScan.dat";
 
   ifstream inpf(file.c_str());
   if(!inpf.is_open()) {
@@ -387,6 +409,13 @@ TFile* thldread(Int_t get=0)
     return 0;
   };
 
+  bool opened = (outputType_ == "Indexed") ? outIndexed_.open(outFileName_) :
+                (outputType_ == "Block")   ? outBlock_.open(outFileName_)   : outFile_.open(outFileName_);
+  if(!opened) {
+    cout << "\nThe file: " << outFileName_ << " can not be opened for writing.\n" << endl;
+    return 0;
+  };
+
   /* Threshould Analysis Histograms */
   const TString filename = "thldread.root";
 
@@ -471,38 +500,23 @@ TFile* thldread(Int_t get=0)
       uint64_t ChamID  = 0xdea;                                     // :12
       uint64_t sumVFAT = int(geb.vfats.size());                     // :28, geb.vfats.size was placed a very temporary here !!!
     
-      geb.header  = (ZSFlag << 40)|(ChamID << 28)|(sumVFAT);
-        if(outputType_ == "Hex"){
-        GEMOnline::writeGEBheader (outFileName_, event_, geb);
-      } else {
-        GEMOnline::writeGEBheaderBinary (outFileName_, event_, geb);
-      } 
+      geb.header  = GEMBits::GEBHeader::ZSFlag::make(ZSFlag)|GEMBits::GEBHeader::ChamID::make(ChamID)|GEMBits::GEBHeader::SumVFAT::make(sumVFAT);
+
+      // Chamber Trailer, OptoHybrid: crc, wordcount, Chamber status
+      uint64_t OHcrc       = BOOST_BINARY( 1 ); // :16
+      uint64_t OHwCount    = BOOST_BINARY( 1 ); // :16
+      uint64_t ChamStatus  = BOOST_BINARY( 1 ); // :16
+      geb.trailer = GEMBits::GEBTrailer::OHcrc::make(OHcrc)|GEMBits::GEBTrailer::OHwCount::make(OHwCount)|GEMBits::GEBTrailer::ChamStatus::make(ChamStatus);
 
       if(ievent < ieventPrint){
         cout << "event " << ievent << " ievent%kUPDATE1 " << ievent%kUPDATE1 << " sumVFAT " << sumVFAT+1 << " GEBDataEvent " << GEBDataEvent << endl;
       }
       event_=ievent;
 
-      // GEB data level
-      GEMOnline::writeGEMevent(gem, geb, vfat);
+      // GEB data level, header + VFATs + trailer
+      GEMOnline::writeGEMevent(gem, geb, vfat, ieventPrint);
       geb.vfats.erase (geb.vfats.begin(),geb.vfats.begin()+kUPDATE1);
       //cout << " geb.vfats.erase " << geb.vfats.size() << endl;
-
-      // Chamber Trailer, OptoHybrid: crc, wordcount, Chamber status
-      uint64_t OHcrc       = BOOST_BINARY( 1 ); // :16
-      uint64_t OHwCount    = BOOST_BINARY( 1 ); // :16
-      uint64_t ChamStatus  = BOOST_BINARY( 1 ); // :16
-      geb.trailer = ((OHcrc << 48)|(OHwCount << 32 )|(ChamStatus << 16));
-    
-      OHcrc      = (0xffff000000000000 & geb.trailer) >> 48; 
-      OHwCount   = (0x0000ffff00000000 & geb.trailer) >> 32; 
-      ChamStatus = (0x00000000ffff0000 & geb.trailer) >> 16;
-    
-      if(outputType_ == "Hex"){
-        GEMOnline::writeGEBtrailer (outFileName_, event_, geb);
-      } else {
-        GEMOnline::writeGEBtrailerBinary (outFileName_, event_, geb);
-      } 
     }
 
     if (ievent%kUPDATE2 == 0 && ievent != 0) {
@@ -513,6 +527,9 @@ TFile* thldread(Int_t get=0)
   }//end loop for events
   cout << "\n The Last Event is  " << LastEvent+1 << endl;
   inpf.close();
+  outFile_.close();
+  outIndexed_.close();
+  outBlock_.close();
 
   // Save all objects in this file
   hfile->Write();
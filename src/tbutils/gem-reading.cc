@@ -7,14 +7,25 @@
 #include <sstream>
 #include <vector>
 #include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+#include <glob.h>
 
 #include <TFile.h>
+#include <TTree.h>
 #include <TNtuple.h>
 #include <TH2.h>
 #include <TProfile.h>
 #include <TCanvas.h>
 #include <TFrame.h>
 #include <TROOT.h>
+#include <RVersion.h>
+#if ROOT_VERSION_CODE < ROOT_VERSION(6,0,0)
+#include <TThread.h>
+#endif
 #include <TSystem.h>
 #include <TRandom3.h>
 #include <TBenchmark.h>
@@ -26,6 +37,16 @@
 #else
 #include "Event.h"
 #endif
+#include "GEMGEBRecord.h"
+#include "GEMIndexedFile.h"
+#include "GEMBlockFile.h"
+#include "GEMFrameScanner.h"
+#include "GEMCrc16.h"
+#include "GEMBitFields.h"
+#include "GEMTreeSettings.h"
+#include "GEMEventLookup.h"
+#include "GEMDQMCounts.h"
+#include "GEMDisplay.h"
 /**
 * ... Threshold Scan ROOT based application, could be used for analisys of XDAQ GEM data ...
 */
@@ -65,6 +86,7 @@ using namespace std;
 
 class GEMOnline {
   public:
+      GEMOnline() : skippedBytes(0), resyncs(0) {}
 
       //! VFAT2 Channel data.
       /*!
@@ -78,22 +100,8 @@ class GEMOnline {
         \author Sergey.Baranov@cern.ch
        */
     
-      struct VFATData {
-        uint16_t BC;      /*!<Banch Crossing number "BC" 16 bits, : 1010:4 (control bits), BC:12 */
-        uint16_t EC;      /*!<Event Counter "EC" 16 bits: 1100:4(control bits) , EC:8, Flag:4 */
-        uint32_t bxExp;   
-        uint16_t bxNum;   /*!<Event Number & SBit, 16 bits : bxNum:6, SBit:6 */
-        uint16_t ChipID;  /*!<ChipID 16 bits, 1110:4 (control bits), ChipID:12 */
-        uint64_t lsData;  /*!<lsData value, bits from 1to64. */ 
-        uint64_t msData;  /*!<msData value, bits from 65to128. */
-        uint16_t crc;     /*!<Checksum number, CRC:16 */
-      };    
-    
-      struct GEBData {
-        uint64_t header;      // ZSFlag:24 ChamID:12 
-        std::vector<VFATData> vfats;
-        uint64_t trailer;     // OHcrc: 16 OHwCount:16  ChamStatus:16
-      };
+      typedef GEMGEBRecord::VFATData VFATData;
+      typedef GEMGEBRecord::GEBData  GEBData;
 
       struct GEMData {
         uint64_t header1;      // AmcNo:4      0000:4     LV1ID:24   BXID:12     DataLgth:20 
@@ -140,22 +148,22 @@ class GEMOnline {
           if( event<0) return(false);
 	  cout << "\nReceived VFAT data word: event " << event << " ivfat  " << ivfat << endl;
   
-          uint8_t   b1010 = (0xf000 & vfat.BC) >> 12;
-          show4bits(b1010); cout << " BC     0x" << hex << (0x0fff & vfat.BC) << dec << endl;
+          uint8_t   b1010 = GEMBits::VFAT::Control::get(vfat.BC);
+          show4bits(b1010); cout << " BC     0x" << hex << GEMBits::VFAT::BC::get(vfat.BC) << dec << endl;
   
-          uint8_t   b1100 = (0xf000 & vfat.EC) >> 12;
-          uint16_t   EC   = (0x0ff0 & vfat.EC) >> 4;
-          uint8_t   Flag  = (0x000f & vfat.EC);
+          uint8_t   b1100 = GEMBits::VFAT::Control::get(vfat.EC);
+          uint16_t   EC   = GEMBits::VFAT::EC::get(vfat.EC);
+          uint8_t   Flag  = GEMBits::VFAT::Flag::get(vfat.EC);
           show4bits(b1100); cout << " EC     0x" << hex << EC << dec << endl; 
           show4bits(Flag);  cout << " Flag  " << endl;
   
-          uint8_t   b1110 = (0xf000 & vfat.ChipID) >> 12;
-          uint16_t ChipID = (0x0fff & vfat.ChipID);
+          uint8_t   b1110 = GEMBits::VFAT::Control::get(vfat.ChipID);
+          uint16_t ChipID = GEMBits::VFAT::ChipID::get(vfat.ChipID);
           show4bits(b1110); cout << " ChipID 0x" << hex << ChipID << dec << " " << endl;
 	  /*
           cout << "     bxExp  0x" << std::setfill('0') << std::setw(4) << hex << vfat.bxExp << dec << " " << endl;
-  	  cout << "     bxNum  0x" << std::setfill('0') << std::setw(2) << hex << ((0xff00 & vfat.bxNum) >> 8) << dec << endl;
-  	  cout << "     SBit   0x" << std::setfill('0') << std::setw(2) << hex <<  (0x00ff & vfat.bxNum)       << dec << endl;
+  	  cout << "     bxNum  0x" << std::setfill('0') << std::setw(2) << hex << GEMBits::VFAT::BxNum::get(vfat.bxNum) << dec << endl;
+  	  cout << "     SBit   0x" << std::setfill('0') << std::setw(2) << hex <<  GEMBits::VFAT::SBit::get(vfat.bxNum)       << dec << endl;
 	  */
           cout << " <127:64>:: 0x" << std::setfill('0') << std::setw(8) << hex << vfat.msData << dec << endl;
           cout << " <63:0>  :: 0x" << std::setfill('0') << std::setw(8) << hex << vfat.lsData << dec << endl;
@@ -174,9 +182,9 @@ class GEMOnline {
       bool PrintChipID(int event, const VFATData& vfat){
         if( event<0 ) return(false);
           cout << "\nevent " << event << endl;
-          uint8_t bitsE = ((vfat.ChipID&0xF000)>>12);
+          uint8_t bitsE = GEMBits::VFAT::Control::get(vfat.ChipID);
           showbits(bitsE);
-          cout << hex << "1110 0x0" << ((vfat.ChipID&0xF000)>>12) << " ChipID 0x" << (vfat.ChipID&0x0FFF) << dec << endl;
+          cout << hex << "1110 0x0" << GEMBits::VFAT::Control::get(vfat.ChipID) << " ChipID 0x" << GEMBits::VFAT::ChipID::get(vfat.ChipID) << dec << endl;
       };
     
       //! showbits function.
@@ -191,20 +199,37 @@ class GEMOnline {
           printf("\n");
         };
 
-      bool readGEBheader(ifstream& inpf, GEBData& geb){
-	inpf >> hex >> geb.header;
-        return(true);
+      template <class Input>
+      bool readGEBheader(Input& inpf, GEBData& geb){
+        return(GEMGEBRecord::readHeader(inpf, geb));
       };	  
 
       bool printGEBheader(const GEBData& geb){
-	cout << hex << geb.header << " ChamID " << ((0x000000fff0000000 & geb.header) >> 28) 
-             << dec << " sumVFAT " << (0x000000000fffffff & geb.header) << endl;
+	cout << hex << geb.header << " ChamID " << GEMBits::GEBHeader::ChamID::get(geb.header) 
+             << dec << " sumVFAT " << GEMBits::GEBHeader::SumVFAT::get(geb.header) << endl;
         return(true);
       };	  
 
-      bool readGEBtrailer(ifstream& inpf, GEBData& geb){
- 	inpf >> hex >> geb.trailer;
-        return(true);
+      //! One 64 bit word of the AMC header and trailer, and the stream specific steps of readAMC.
+      static bool readWord(GEMHexReader& inpf, uint64_t& w){ return(inpf.readHex(w)); }
+      static bool readWord(GEMBinaryReader& inpf, uint64_t& w){ return(inpf.readWord(w)); }
+      static bool skipWord(GEMHexReader& inpf){ return(inpf.skipToken()); }
+      static bool skipWord(GEMBinaryReader& inpf){ return(inpf.seek(inpf.tell() + 8)); }
+      void skipped(size_t from, size_t to){ if(to > from){ skippedBytes += to - from; resyncs++; } }
+      static GEMFrameScanner::Status endStatus(GEMHexReader& inpf){ return(inpf.ended() ? GEMFrameScanner::kIncomplete : GEMFrameScanner::kBad); }
+      static GEMFrameScanner::Status endStatus(GEMBinaryReader&){ return(GEMFrameScanner::kIncomplete); }
+      //! The text stream has no word positions, its length is checked at the end.
+      static GEMFrameScanner::Status checkLength(GEMHexReader&, size_t, uint64_t){ return(GEMFrameScanner::kGood); }
+      //! Binary: all DataLgth words present and trailer1 at the last one.
+      static GEMFrameScanner::Status checkLength(GEMBinaryReader& inpf, size_t start, uint64_t DataLgth){
+        if(inpf.getEnd() - start < 8*DataLgth) return(GEMFrameScanner::kIncomplete);
+        uint64_t trailer1 = GEMBinaryReader::load64(inpf.data() + start + 8*(DataLgth - 1));
+        return(GEMBits::AMCTrailer1::DataLgth::get(trailer1) == DataLgth ? GEMFrameScanner::kGood : GEMFrameScanner::kBad);
+      };
+
+      template <class Input>
+      bool readGEBtrailer(Input& inpf, GEBData& geb){
+        return(GEMGEBRecord::readTrailer(inpf, geb));
       };	  
 
   //! Read 1-128 channels data
@@ -217,19 +242,538 @@ class GEMOnline {
         reading GEM VFAT2 data (BC,EC,bxNum,ChipID,(lsData & msData), crc.
        */
     
-      bool readEvent(ifstream& inpf, int event, VFATData& vfat){
+      template <class Input>
+      bool readEvent(Input& inpf, int event, VFATData& vfat){
         if(event<0) return(false);
-          inpf >> hex >> vfat.BC;
-          inpf >> hex >> vfat.EC;
-          /* inpf >> hex >> vfat.bxExp;
-          inpf >> hex >> vfat.bxNum;
-          */
-	  inpf >> hex >> vfat.ChipID;
-          inpf >> hex >> vfat.lsData;
-          inpf >> hex >> vfat.msData;
-          inpf >> hex >> vfat.crc;
-        return(true);
+        return(GEMGEBRecord::readVFAT(inpf, vfat));
       };	  
+
+      //! Read one GEB record
+      /*!
+        GEB header, sumVFAT VFAT2 frames into geb.vfats and GEB trailer, from the text or the binary stream.
+        A record with wrong control nibbles or a misplaced trailer is skipped up to the next valid record,
+        the skipped bytes are added to skippedBytes. On false the stream is left at the start of the
+        record which could not be completed, to be read again when the file has grown.
+       */
+
+      bool readGEB(GEMBinaryReader& inpf, int event, GEBData& geb){
+        size_t start = inpf.tell(), size;
+        size_t avail = inpf.getEnd() - start;
+        const unsigned char* p = inpf.data() + start;
+        // one checkGEB per record, resync() checks the record it stops at
+        GEMFrameScanner::Status status = GEMFrameScanner::checkGEB(p, avail, size);
+        if(status == GEMFrameScanner::kBad){
+          size_t skip = GEMFrameScanner::resync(p, avail, status, size);
+          skippedBytes += skip; resyncs++;
+          inpf.seek(start + skip);
+        }
+        if(status != GEMFrameScanner::kGood) return(false);
+        decodeCheckedGEB(inpf, event, geb);
+        return(true);
+      };
+
+      GEMFrameScanner::Status readCheckedGEB(GEMBinaryReader& inpf, int event, GEBData& geb, uint64_t maxVFAT = 0xffff){
+        size_t size;
+        const unsigned char* p = inpf.data() + inpf.tell();
+        if(inpf.getEnd() - inpf.tell() >= GEMBinaryReader::kGEBheaderSize &&
+           GEMBits::GEBHeader::SumVFAT::get(GEMBinaryReader::load64(p)) > maxVFAT) return(GEMFrameScanner::kBad);
+        GEMFrameScanner::Status status = GEMFrameScanner::checkGEB(p, inpf.getEnd() - inpf.tell(), size);
+        if(status != GEMFrameScanner::kGood) return(status);
+        decodeCheckedGEB(inpf, event, geb);
+        return(GEMFrameScanner::kGood);
+      };
+
+      //! Decode a record checkGEB() found kGood, the framing is verified, plain decoding.
+      void decodeCheckedGEB(GEMBinaryReader& inpf, int event, GEBData& geb){
+        readGEBheader(inpf, geb);
+        uint64_t sumVFAT = GEMBits::GEBHeader::SumVFAT::get(geb.header);
+        geb.vfats.resize(sumVFAT);
+        for(uint64_t ivfat=0; ivfat<sumVFAT; ivfat++){
+          VFATData& vfat = geb.vfats[ivfat];
+          readEvent(inpf, event, vfat);
+          vfat.crcOK = GEMCrc16::check(vfat);
+        }
+        readGEBtrailer(inpf, geb);
+      };
+
+      bool readGEB(GEMHexReader& inpf, int event, GEBData& geb){
+        bool damaged = false;
+        for(;;){
+          size_t start = inpf.tell();
+          GEMFrameScanner::Status status = readCheckedGEB(inpf, event, geb);
+          // as for the binary resync, only a record with VFAT2 frames counts as found again
+          if(status == GEMFrameScanner::kGood && damaged && geb.vfats.empty()) status = GEMFrameScanner::kBad;
+          if(status == GEMFrameScanner::kGood) return(true);
+          inpf.seek(start);
+          if(status == GEMFrameScanner::kIncomplete) return(false);
+          // damaged: drop one token and try again from there
+          if(!inpf.skipToken()){ inpf.seek(start); return(false); }
+          skippedBytes += inpf.tell() - start;
+          if(!damaged) resyncs++;
+          damaged = true;
+        }
+      };
+
+      GEMFrameScanner::Status readCheckedGEB(GEMHexReader& inpf, int event, GEBData& geb, uint64_t maxVFAT = 0xffff){
+        if(!readGEBheader(inpf, geb)) return(inpf.ended() ? GEMFrameScanner::kIncomplete : GEMFrameScanner::kBad);
+        uint64_t sumVFAT = GEMBits::GEBHeader::SumVFAT::get(geb.header);
+        if(sumVFAT > maxVFAT) return(GEMFrameScanner::kBad);
+        geb.vfats.resize(sumVFAT);
+        for(uint64_t ivfat=0; ivfat<sumVFAT; ivfat++){
+          VFATData& vfat = geb.vfats[ivfat];
+          if(!readEvent(inpf, event, vfat)) return(inpf.ended() ? GEMFrameScanner::kIncomplete : GEMFrameScanner::kBad);
+          if(!GEMFrameScanner::validFrame(vfat.BC, vfat.EC, vfat.ChipID)) return(GEMFrameScanner::kBad);
+          vfat.crcOK = GEMCrc16::check(vfat);
+        }
+        if(!readGEBtrailer(inpf, geb)) return(inpf.ended() ? GEMFrameScanner::kIncomplete : GEMFrameScanner::kBad);
+        return(GEMFrameScanner::validTrailer(geb.trailer) ? GEMFrameScanner::kGood : GEMFrameScanner::kBad);
+      };
+
+      //! 64 bit words of the binary layout, counted by DataLgth
+      static const uint64_t kAMCwords  = 5;   /*!<header1..3, trailer2, trailer1 */
+      static const uint64_t kGEBwords  = 2;   /*!<GEB header and trailer */
+      static const uint64_t kVFATwords = 3;   /*!<one VFAT2 frame, 24 bytes */
+
+      //! Read one AMC record
+      /*!
+        header1..3, DAVCount GEB records and trailer2, trailer1, decoded in one pass from the text or
+        the binary stream. DataLgth of header1 is the record length in 64 bit words of the binary layout;
+        it bounds the number of VFAT2 frames before any of them is read, and it must agree with the words
+        read and with DataLgth and LV1IDT of trailer1. A damaged record is skipped word by word (binary)
+        or token by token (text) up to the next valid one. A record which runs past the end of the data is
+        waited for, unless a complete record follows it, then it was damaged too.
+       */
+
+      template <class Input>
+      bool readAMC(Input& inpf, int event, GEMData& amc){
+        size_t first = inpf.tell(), pending = first;
+        bool incomplete = false;
+        for(;;){
+          size_t start = inpf.tell();
+          GEMFrameScanner::Status status = readCheckedAMC(inpf, event, amc);
+          if(status == GEMFrameScanner::kGood){
+            skipped(first, start);
+            return(true);
+          }
+          inpf.seek(start);
+          // an incomplete record may still be completed by the DAQ, unless a complete one follows it
+          if(status == GEMFrameScanner::kIncomplete && !incomplete){ incomplete = true; pending = start; }
+          if(!skipWord(inpf)){
+            size_t stop = incomplete ? pending : start;
+            skipped(first, stop);
+            inpf.seek(stop);
+            return(false);
+          }
+        }
+      };
+
+      template <class Input>
+      GEMFrameScanner::Status readCheckedAMC(Input& inpf, int event, GEMData& amc){
+        size_t start = inpf.tell();
+        if(!readWord(inpf, amc.header1) || !readWord(inpf, amc.header2) || !readWord(inpf, amc.header3)) return(endStatus(inpf));
+        uint64_t DataLgth = GEMBits::AMCHeader1::DataLgth::get(amc.header1);
+        uint64_t nGEBs    = GEMBits::AMCHeader3::DAVCount::get(amc.header3);
+        if(GEMBits::AMCHeader1::Zero::get(amc.header1) != 0 || DataLgth < kAMCwords + nGEBs*kGEBwords) return(GEMFrameScanner::kBad);
+        GEMFrameScanner::Status status = checkLength(inpf, start, DataLgth);
+        if(status != GEMFrameScanner::kGood) return(status);
+
+        // frames left for the GEBs, no vfats vector grows beyond them
+        uint64_t frames = (DataLgth - kAMCwords - nGEBs*kGEBwords)/kVFATwords;
+        amc.gebs.resize(nGEBs);
+        for(uint64_t igeb = 0; igeb < nGEBs; ++igeb){
+          GEBData& geb = amc.gebs[igeb];
+          status = readCheckedGEB(inpf, event, geb, frames);
+          if(status != GEMFrameScanner::kGood) return(status);
+          frames -= geb.vfats.size();
+        }
+        if(!readWord(inpf, amc.trailer2) || !readWord(inpf, amc.trailer1)) return(endStatus(inpf));
+        if(frames != 0 ||
+           GEMBits::AMCTrailer1::DataLgth::get(amc.trailer1) != DataLgth ||
+           GEMBits::AMCTrailer1::Zero::get(amc.trailer1) != 0 ||
+           GEMBits::AMCTrailer1::LV1IDT::get(amc.trailer1) != (GEMBits::AMCHeader1::LV1ID::get(amc.header1) & GEMBits::AMCTrailer1::LV1IDT::low))
+          return(GEMFrameScanner::kBad);
+        return(GEMFrameScanner::kGood);
+      };
+
+      bool printAMCheader(const GEMData& amc){
+        cout << "AMC " << GEMBits::AMCHeader1::AmcNo::get(amc.header1) << hex
+             << " LV1ID " << GEMBits::AMCHeader1::LV1ID::get(amc.header1) << " BXID " << GEMBits::AMCHeader1::BXID::get(amc.header1)
+             << " OrN " << GEMBits::AMCHeader2::OrN::get(amc.header2) << " BoardID " << GEMBits::AMCHeader2::BoardID::get(amc.header2)
+             << dec << " DataLgth " << GEMBits::AMCHeader1::DataLgth::get(amc.header1) << " nGEBs " << amc.gebs.size() << endl;
+        return(true);
+      };
+
+      uint64_t skippedBytes;   /*!<bytes dropped to resynchronise on a valid GEB record */
+      uint64_t resyncs;        /*!<number of damaged places */
+};
+
+//! Parallel decoding of several run files, or of the blocks of one block file.
+/*!
+  \brief GEMMultiFileInput
+  a pool of worker threads decodes files (text, binary, indexed or block
+  compressed) into GEB records, next() hands the records out in the order of
+  the file list, so GEMtree is filled exactly as for the files read one after
+  the other. Given a GEMBlockReader the units are its blocks instead of files,
+  a block which does not inflate or fails its CRC is reported and skipped.
+
+  A unit is decoded in chunks of kChunkRecords records, or of one block, and
+  its worker waits while kChunks of them are not handed out yet. At most
+  "window" units are decoded at a time, so the decoded records in memory are
+  bounded whatever the size of the files.
+
+  The worker which decoded a chunk also counts its records for the DQM, next()
+  adds the counts of a chunk once it has handed out all its records, in file
+  order. finish() stops the workers and counts the records handed out of the
+  chunk being read, so counts() has exactly the records next() gave.
+ */
+
+class GEMMultiFileInput {
+  public:
+    static const size_t kChunkRecords = 1024;   // GEB records per chunk of a file
+    static const size_t kChunks       = 2;      // chunks of a unit decoded ahead of next()
+
+    GEMMultiFileInput(const vector<string>& files_, bool binary_, unsigned nJobs, unsigned window_) :
+      files(files_), binary(binary_), blockf(0), slots(files_.size()), window(window_ ? window_ : 1),
+      nextFile(0), current(0), currentGEB(0), skipped(0), nResyncs(0), stop(false), finished(false)
+    {
+      start(nJobs);
+    };
+
+    GEMMultiFileInput(const GEMBlockReader& blockf_, unsigned nJobs, unsigned window_) :
+      binary(true), blockf(&blockf_), slots(blockf_.nBlocks()), window(window_ ? window_ : 1),
+      nextFile(0), current(0), currentGEB(0), skipped(0), nResyncs(0), stop(false), finished(false)
+    {
+      start(nJobs);
+    };
+
+    ~GEMMultiFileInput(){ finish(); }
+
+    //! Next GEB record in file order, false after the last one.
+    /*!
+      The record is copied into geb, which keeps its capacity, the chunk keeps
+      it until all its records are handed out, for finish().
+     */
+    bool next(GEMOnline::GEBData& geb){
+      while(!finished && current < slots.size()){
+        Slot& slot = slots[current];
+        Chunk* chunk = 0;
+        {
+          std::unique_lock<std::mutex> lock(mtx);
+          while(slot.chunks.empty() && !slot.done) cv.wait(lock);
+          if(!slot.chunks.empty()) chunk = &slot.chunks.front();
+        }
+        if(chunk){
+          if(currentGEB < chunk->gebs.size()){
+            geb = chunk->gebs[currentGEB++];
+            return(true);
+          }
+          {
+            std::lock_guard<std::mutex> lock(countsMtx);
+            handed.merge(*chunk->counts);
+          }
+          delete chunk->counts;
+          {
+            std::lock_guard<std::mutex> lock(mtx);
+            slot.chunks.pop_front();
+            currentGEB = 0;
+          }
+          cv.notify_all();
+          continue;
+        }
+        if(!slot.ok){
+          if(blockf) cout << "\nBlock " << current << " is corrupted, " << blockf->block(current).nRecords << " GEB records skipped.\n" << endl;
+          else       cout << "\nThe file: " << files[current] << " is missing or truncated.\n" << endl;
+        }
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          current++; currentGEB = 0;
+        }
+        cv.notify_all();
+      }
+      return(false);
+    };
+
+    //! The DQM counts of the records handed out so far.
+    void counts(GEMDQMCounts& total){
+      std::lock_guard<std::mutex> lock(countsMtx);
+      total = handed;
+    };
+
+    //! Stop the workers, count the records handed out of the chunk being read, next() returns false from now on.
+    void finish(){
+      if(finished) return;
+      { std::lock_guard<std::mutex> lock(mtx); stop = true; }
+      cv.notify_all();
+      for(size_t i = 0; i < workers.size(); ++i) workers[i].join();
+      finished = true;
+      if(current < slots.size() && !slots[current].chunks.empty()){
+        const Chunk& chunk = slots[current].chunks.front();
+        std::lock_guard<std::mutex> lock(countsMtx);
+        for(size_t i = 0; i < currentGEB; ++i) handed.addGEB(chunk.gebs[i]);
+      }
+      for(size_t i = 0; i < slots.size(); ++i){
+        for(size_t j = 0; j < slots[i].chunks.size(); ++j) delete slots[i].chunks[j].counts;
+        slots[i].chunks.clear();
+      }
+    };
+
+    //! Damaged data skipped by the workers so far.
+    uint64_t skippedBytes(){ std::lock_guard<std::mutex> lock(mtx); return skipped; }
+    uint64_t resyncs()     { std::lock_guard<std::mutex> lock(mtx); return nResyncs; }
+
+  private:
+    struct Chunk {
+      Chunk() : counts(0) {}
+      std::vector<GEMOnline::GEBData> gebs;
+      GEMDQMCounts* counts;         // of gebs, by the worker
+    };
+
+    struct Slot {
+      Slot() : done(false), ok(false) {}
+      std::deque<Chunk> chunks;     // decoded, next() reads the first one
+      bool done;                    // no chunk follows
+      bool ok;
+    };
+
+    void start(unsigned nJobs){
+      if(nJobs == 0) nJobs = 1;
+      for(unsigned i = 0; i < nJobs && i < slots.size(); ++i) workers.push_back(std::thread(&GEMMultiFileInput::worker, this));
+    };
+
+    bool stopping(){ std::lock_guard<std::mutex> lock(mtx); return stop; }
+
+    void worker(){
+      std::vector<unsigned char> buffer;
+      for(;;){
+        size_t ifile;
+        {
+          std::unique_lock<std::mutex> lock(mtx);
+          while(!stop && nextFile < slots.size() && nextFile >= current + window) cv.wait(lock);
+          if(stop || nextFile >= slots.size()) return;
+          ifile = nextFile++;
+        }
+        bool ok = blockf ? decodeBlock(*blockf, ifile, ifile, buffer) : decodeFile(files[ifile], ifile);
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          slots[ifile].ok   = ok;
+          slots[ifile].done = true;
+        }
+        cv.notify_all();
+      }
+    };
+
+    //! Count the records and queue them as the next chunk of slot islot, false once stopped.
+    bool push(size_t islot, std::vector<GEMOnline::GEBData>& gebs){
+      if(gebs.empty()) return(!stopping());
+      GEMDQMCounts* chunkCounts = new GEMDQMCounts();
+      for(size_t i = 0; i < gebs.size(); ++i) chunkCounts->addGEB(gebs[i]);
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        Slot& slot = slots[islot];
+        while(!stop && slot.chunks.size() >= kChunks) cv.wait(lock);
+        if(stop){
+          delete chunkCounts;
+          return(false);
+        }
+        slot.chunks.push_back(Chunk());
+        slot.chunks.back().gebs.swap(gebs);
+        slot.chunks.back().counts = chunkCounts;
+      }
+      cv.notify_all();
+      gebs.clear();
+      return(true);
+    };
+
+    bool decodeFile(const string& file, size_t islot){
+      if(GEMBlockReader::isBlockFile(file)){
+        GEMBlockReader blkf;
+        if(!blkf.open(file)) return(false);
+        std::vector<unsigned char> buffer;
+        bool ok = (blkf.skippedBytes() == 0);
+        for(size_t i = 0; i < blkf.nBlocks() && !stopping(); ++i) ok = decodeBlock(blkf, i, islot, buffer) && ok;
+        return(ok);
+      }
+      std::vector<GEMOnline::GEBData> gebs;
+      bool ok;
+      if(GEMIndexedReader::isIndexed(file)){
+        GEMIndexedReader idxf;
+        ok = idxf.open(file) && decodeAll(idxf.stream(), islot, gebs);
+      } else if(binary){
+        GEMBinaryReader binf;
+        ok = binf.open(file) && decodeAll(binf, islot, gebs);
+      } else {
+        GEMHexReader inpf;
+        ok = inpf.open(file) && decodeAll(inpf, islot, gebs);
+      }
+      push(islot, gebs);
+      return(ok);
+    };
+
+    //! Decompress block i and decode its records as one chunk, the block is dropped as a whole if it is damaged.
+    bool decodeBlock(const GEMBlockReader& blkf, size_t i, size_t islot, std::vector<unsigned char>& buffer){
+      if(!blkf.decodeBlock(i, buffer)) return(false);
+      GEMBinaryReader binf;
+      binf.attach(buffer.empty() ? 0 : &buffer[0], buffer.size());
+      std::vector<GEMOnline::GEBData> gebs;
+      if(!decodeAll(binf, islot, gebs, false) || gebs.size() != blkf.block(i).nRecords) return(false);
+      push(islot, gebs);
+      return(true);
+    };
+
+    //! Decode into gebs, every kChunkRecords records go to slot islot unless chunked is false.
+    template <class Input>
+    bool decodeAll(Input& inpf, size_t islot, std::vector<GEMOnline::GEBData>& gebs, bool chunked = true){
+      GEMOnline online;
+      bool ok = true;
+      while(ok && inpf.good()){
+        gebs.push_back(GEMOnline::GEBData());
+        if(!online.readGEB(inpf, 0, gebs.back())){
+          gebs.pop_back();
+          ok = false;
+        }
+        if(chunked && gebs.size() >= kChunkRecords && !push(islot, gebs)) break;
+      }
+      std::lock_guard<std::mutex> lock(mtx);
+      skipped  += online.skippedBytes;
+      nResyncs += online.resyncs;
+      return(ok);
+    };
+
+    vector<string>           files;
+    bool                     binary;
+    const GEMBlockReader*    blockf;       // block mode: one slot per block
+    std::vector<Slot>        slots;
+    size_t                   window;
+    size_t                   nextFile;     // next file for a worker
+    size_t                   current;      // file handed out by next()
+    size_t                   currentGEB;   // in the first chunk of current
+    uint64_t                 skipped;      // GEMOnline::skippedBytes of all workers
+    uint64_t                 nResyncs;
+    bool                     stop;
+    bool                     finished;     // by finish(), next() hands out nothing more
+    std::mutex               mtx;
+    std::condition_variable  cv;
+    std::vector<std::thread> workers;
+    GEMDQMCounts             handed;       // of the records handed out by next()
+    std::mutex               countsMtx;
+};
+
+//! GEMtree and GEMflat filling, on the calling thread or on a writer thread.
+/*!
+  \brief GEMEventWriter
+  next() gives the Event and EventFlat to build the next entry in, fill()
+  hands them over. Without a writer thread fill() calls TTree::Fill() and
+  clears them. With a writer thread (depth > 0) the decoding thread builds
+  the entry in one of depth recycled pairs while the writer thread fills and
+  compresses the previous ones, next() waits only when all depth pairs are
+  queued. Both trees are filled by the same thread since a TFile must not be
+  written to from two threads at once. Nothing else may use the file until
+  close() has returned.
+ */
+
+class GEMEventWriter {
+  public:
+    GEMEventWriter(TTree* full_, TTree* flat_, const GEMTreeSettings& settings, unsigned depth) :
+      full(full_), flat(flat_), evSlot(0), flatSlot(0), current(0), stop(false), nFilled(0)
+    {
+      pool.resize(depth ? depth : 1);
+      for(size_t i = 0; i < pool.size(); ++i){
+        pool[i].ev   = new Event();
+        pool[i].flat = new EventFlat();
+        freeList.push_back(&pool[i]);
+      }
+      // the branches read through evSlot/flatSlot, set to the entry being filled
+      evSlot   = pool[0].ev;
+      flatSlot = pool[0].flat;
+      if(full) full->Branch("GEMEvents", &evSlot, settings.basketSize, settings.splitLevel);
+      if(flat) flat->Branch("GEMFlat.", &flatSlot, settings.basketSize, 99);
+      if(depth) writer = std::thread(&GEMEventWriter::run, this);
+    };
+
+    ~GEMEventWriter(){
+      close();
+      for(size_t i = 0; i < pool.size(); ++i){ delete pool[i].ev; delete pool[i].flat; }
+    };
+
+    bool async() const { return writer.joinable(); }
+
+    //! Empty Event and EventFlat for the next entry.
+    void next(Event*& ev, EventFlat*& flat_){
+      std::unique_lock<std::mutex> lock(mtx);
+      cvFree.wait(lock, [this]{ return !freeList.empty(); });
+      current = freeList.front();
+      freeList.pop_front();
+      ev = current->ev;
+      flat_ = current->flat;
+    };
+
+    //! The entry from next() is complete.
+    void fill(){
+      if(!async()){
+        write(current);
+        freeList.push_back(current);
+        return;
+      }
+      { std::lock_guard<std::mutex> lock(mtx); queue.push_back(current); }
+      cvQueue.notify_one();
+    };
+
+    //! Write the queued entries and stop the writer thread.
+    void close(){
+      if(!writer.joinable()) return;
+      { std::lock_guard<std::mutex> lock(mtx); stop = true; }
+      cvQueue.notify_one();
+      writer.join();
+    };
+
+    uint64_t filled() const { return nFilled; }
+
+  private:
+    struct Entry {
+      Event*     ev;
+      EventFlat* flat;
+    };
+
+    void write(Entry* e){
+      evSlot   = e->ev;
+      flatSlot = e->flat;
+      if(full) full->Fill();
+      if(flat) flat->Fill();
+      e->ev->Clear();
+      e->flat->Clear();
+      nFilled++;
+    };
+
+    void run(){
+      for(;;){
+        Entry* e;
+        {
+          std::unique_lock<std::mutex> lock(mtx);
+          cvQueue.wait(lock, [this]{ return stop || !queue.empty(); });
+          if(queue.empty()) return;
+          e = queue.front();
+          queue.pop_front();
+        }
+        write(e);
+        { std::lock_guard<std::mutex> lock(mtx); freeList.push_back(e); }
+        cvFree.notify_one();
+      }
+    };
+
+    TTree*                   full;
+    TTree*                   flat;
+    Event*                   evSlot;
+    EventFlat*               flatSlot;
+    std::vector<Entry>       pool;
+    std::deque<Entry*>       freeList;
+    std::deque<Entry*>       queue;       // complete entries, oldest first
+    Entry*                   current;
+    bool                     stop;
+    uint64_t                 nFilled;
+    std::mutex               mtx;
+    std::condition_variable  cvFree;
+    std::condition_variable  cvQueue;
+    std::thread              writer;
 };
 
 //! root function.
@@ -250,21 +794,145 @@ TFile* thldread(Int_t get=0)
 #endif
 { cout<<"---> Main()"<<endl;
 
+  string file="DataParker.dat";
+  bool binaryInput = false;     // --binary : file written by gem-re-write with outputType_ != "Hex"
+  bool follow      = false;     // --follow : keep reading while the DAQ appends to the file
+  int  pollMs      = 500;       // --poll N : follow mode, ms between checks for new data
+  int  idleSec     = 0;         // --idle N : follow mode, stop after N s without new data, 0 never
+  long eventSel    = -1;        // --event N   : indexed file, decode only event N
+  long chamberSel  = -1;        // --chamber ID: indexed file, decode only this chamber
+  vector<string> files;         // more than one input file or --glob : decoded in parallel
+  unsigned nJobs   = std::thread::hardware_concurrency(); // --jobs N : decoding threads for several files or blocks
+  string treeType  = "both";    // --tree full|flat|both : GEMtree (Event), GEMflat (EventFlat, one branch per field) or both
+  GEMTreeSettings treeSettings; // --basket, --autoflush, --split, --algorithm, --level, --compression : DQMlight.root output
+  bool amcInput    = false;     // --amc : the file holds AMC records, header1..3, GEB records, trailer2, trailer1
+  string writeMode = "sync";    // --write sync|async : fill and compress the trees here or on a writer thread
+  int  imtThreads  = -1;        // --imt N : ROOT implicit multi-threading for basket compression, 0 all cores, -1 off
+  int  refreshMs   = 1000;      // --refresh N : ms between snapshots of the live canvas, decoding on its own thread, 0 no live canvas
+
 #ifndef __CINT__
+  // our own options, everything else goes to TApplication
+  int appArgc = 1;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if      (arg == "--binary")         binaryInput = true;
+    else if (arg == "--amc")            amcInput = true;
+    else if (arg == "--follow")         follow = true;
+    else if (arg == "--poll" && i+1<argc) pollMs  = atoi(argv[++i]);
+    else if (arg == "--idle" && i+1<argc) idleSec = atoi(argv[++i]);
+    else if (arg == "--event"   && i+1<argc) eventSel   = strtol(argv[++i], 0, 0);
+    else if (arg == "--chamber" && i+1<argc) chamberSel = strtol(argv[++i], 0, 0);
+    else if (arg == "--jobs"    && i+1<argc) nJobs      = atoi(argv[++i]);
+    else if (arg == "--tree"    && i+1<argc) treeType   = argv[++i];
+    else if (arg == "--write"   && i+1<argc) writeMode  = argv[++i];
+    else if (arg == "--imt"     && i+1<argc) imtThreads = atoi(argv[++i]);
+    else if (arg == "--refresh" && i+1<argc) refreshMs  = atoi(argv[++i]);
+    else if (treeSettings.parse(i, argc, argv)) continue;
+    else if (arg == "--glob"    && i+1<argc) {
+      glob_t g;
+      const char* pattern = argv[++i];
+      size_t nMatched = 0;
+      if(glob(pattern, 0, 0, &g) == 0) for(size_t k = 0; k < g.gl_pathc; ++k, ++nMatched) files.push_back(g.gl_pathv[k]);
+      globfree(&g);
+      // not the default file instead
+      if(nMatched == 0){
+        cout << "\nNo file matches --glob " << pattern << "\n" << endl;
+        return 0;
+      }
+    }
+    else if (arg.size() && arg[0]!='-') files.push_back(arg);
+    else                                argv[appArgc++] = argv[i];
+  }
+  argc = appArgc;
+
   TApplication App("App", &argc, argv);
 #endif
+  if(files.size() == 1) file = files[0];
+  bool multiInput = files.size() > 1;
+  if(nJobs == 0) nJobs = 1;
  
   GEMOnline         Online;   
-  GEMOnline::VFATData vfat;
-  GEMOnline::GEBData   geb;
+  // one event: the AMC record with --amc, else a single GEB record with zero AMC header and trailer
+  GEMOnline::GEMData   amc;
+  amc.header1 = amc.header2 = amc.header3 = amc.trailer2 = amc.trailer1 = 0;
+  amc.gebs.resize(1);
+
+  // indexed files written by gem-re-write --type Indexed are recognised by their magic
+  GEMIndexedReader idxf;
+  bool indexedInput = !multiInput && GEMIndexedReader::isIndexed(file);
+  if(indexedInput){
+    if(!idxf.open(file)) {
+      cout << "\nThe file: " << file.c_str() << " has no valid event index.\n" << endl;
+      return 0;
+    };
+    binaryInput = true;
+    follow = false;
+  }
 
-  string file="DataParker.dat";
+  // block compressed files written by gem-re-write --type Block, blocks are inflated and decoded in parallel
+  GEMBlockReader blockf;
+  bool blockInput = !multiInput && !indexedInput && GEMBlockReader::isBlockFile(file);
+  if(blockInput){
+    if(!blockf.open(file)) {
+      cout << "\nThe file: " << file.c_str() << " is not a valid block file.\n" << endl;
+      return 0;
+    };
+    if(blockf.skippedBytes()) cout << "\nThe file: " << file.c_str() << " has damaged block headers, "
+                                   << blockf.skippedBytes() << " bytes skipped.\n" << endl;
+    binaryInput = true;
+    multiInput  = true;
+  }
+
+  // the index and the parallel decoding work on GEB records
+  if(amcInput && (indexedInput || multiInput)) {
+    cout << "\n--amc needs one text or binary file of AMC records.\n" << endl;
+    return 0;
+  };
 
-  ifstream inpf(file.c_str());
-  if(!inpf.is_open()) {
+  GEMHexReader inpf;
+  GEMBinaryReader binfile;
+  GEMBinaryReader& binf = indexedInput ? idxf.stream() : binfile;
+  if(!indexedInput && !multiInput){
+    if(binaryInput) binf.open(file);
+    else            inpf.open(file);
+  }
+  if(!inpf.is_open() && !binf.is_open() && !multiInput) {
     cout << "\nThe file: " << file.c_str() << " is missing.\n" << endl;
     return 0;
   };
+  inpf.setFollow(follow);
+
+  // every DQM histogram is counted in integers, per (ChamID, ChipID) too. Several inputs: the decoding
+  // workers count the records of every unit, multi adds them up in file order as it hands them out
+  GEMDQMCounts dqm;
+
+  // several files: decoded on a worker pool, consumed here in the order given
+  GEMMultiFileInput* multi = 0;
+  if(blockInput){
+    cout << "Decoding " << blockf.nBlocks() << " blocks with " << nJobs << " threads" << endl;
+    multi = new GEMMultiFileInput(blockf, nJobs, 2*nJobs);
+    follow = false;
+  } else if(multiInput){
+    cout << "Decoding " << files.size() << " files with " << nJobs << " threads" << endl;
+    multi = new GEMMultiFileInput(files, binaryInput, nJobs, 2*nJobs);
+    follow = false;
+  }
+
+  // random access: index entries to decode instead of the whole file
+  bool select = indexedInput && (eventSel >= 0 || chamberSel >= 0);
+  std::vector<size_t> selected;
+  if(select){
+    if(chamberSel >= 0) selected = idxf.findChamber(chamberSel);
+    else for(size_t i = 0; i < idxf.entries(); ++i) selected.push_back(i);
+    if(eventSel >= 0){
+      size_t first = idxf.findEvent(eventSel);
+      std::vector<size_t> match;
+      for(size_t i = first; i < idxf.entries() && idxf.entry(i).event == (uint64_t)eventSel; ++i)
+        if(std::binary_search(selected.begin(), selected.end(), i)) match.push_back(i);
+      selected.swap(match);
+    }
+    cout << "Selected " << selected.size() << " of " << idxf.entries() << " GEB records" << endl;
+  }
 
   /* Threshould Analysis Histograms */
   const TString filename = "DQMlight.root";
@@ -277,10 +945,35 @@ TFile* thldread(Int_t get=0)
   c1->GetFrame()->SetBorderMode(-1);
   c1->Divide(3,3);
 
+  // basket compression on the ROOT thread pool, the trees must be created afterwards
+  if(imtThreads >= 0){
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,8,0)
+    ROOT::EnableImplicitMT(imtThreads);
+    cout << "Implicit multi-threading, " << ROOT::GetImplicitMTPoolSize() << " threads" << endl;
+#else
+    cout << "--imt needs ROOT 6.08 or later, ignored" << endl;
+#endif
+  }
+  // the writer thread fills the trees while this thread draws, the display draws while a thread decodes
+  if(writeMode == "async" || refreshMs > 0){
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+    ROOT::EnableThreadSafety();
+#else
+    TThread::Initialize();
+#endif
+  }
+
   TFile* hfile = NULL;
   hfile = new TFile(filename,"RECREATE","Threshold Scan ROOT file with histograms");
+  treeSettings.apply(hfile);
+  cout << "Trees: " << treeSettings.describe() << endl;
 
   TTree GEMtree("GEMtree","A Tree with GEM Events");
+  TTree GEMflat("GEMflat","GEM Events, one branch per VFAT2 field");
+  treeSettings.apply(GEMtree);
+  treeSettings.apply(GEMflat);
+  bool fullTree = (treeType != "flat");
+  bool flatTree = (treeType != "full");
 
   TH1F* hiVFAT = new TH1F("VFAT", "Number VFAT per event", 100, (Double_t)-0.5,(Double_t)300.5 );
   hiVFAT->SetFillColor(48);
@@ -303,6 +996,10 @@ TFile* thldread(Int_t get=0)
   TH1F* hiCRC = new TH1F("CRC",     "CRC",             100, 0x0, 0xffff );
   hiCRC->SetFillColor(48);
 
+  // CRC-16 check of every frame, counted per ChipID:12
+  TH1F* hiCRCErr = new TH1F("CRCErr", "CRC errors per ChipID", 0x1000, -0.5, 0xfff+0.5 );
+  hiCRCErr->SetFillColor(48);
+
   // Booking of all 128 histograms for each VFAT2 channel
   TH1F* hiCh128 = new TH1F("Ch128", "all channels",      128, 0.,   128. );
   hiCh128->SetFillColor(48);
@@ -318,113 +1015,215 @@ TFile* thldread(Int_t get=0)
     histos[hi] = new TH1F(histName.str().c_str(), histTitle.str().c_str(), 100, 0., 0xf );
   }
 
+  // the histograms are set from the counts when they are shown or saved, the chips are written to Chips/ at the end
+  GEMChipHistograms& chipHistos = dqm.chips;
+  cout << "Channel occupancy: " << (GEMSlicedCounter::hasAVX2() ? "avx2" : "scalar") << " flush" << endl;
+  auto fillHistograms = [&](){
+      if(multi) multi->counts(dqm);
+      dqm.vfat.fill(hiVFAT);
+      dqm.b1010.fill(hi1010);
+      dqm.b1100.fill(hi1100);
+      dqm.flag.fill(hiFlag);
+      dqm.b1110.fill(hi1110);
+      dqm.chip.fill(hiChip);
+      dqm.crc.fill(hiCRC);
+      uint64_t nErrors = 0;
+      for (int chip = 0; chip < 0x1000; ++chip) {
+        hiCRCErr->SetBinContent(chip+1, dqm.crcErrors[chip]);
+        nErrors += dqm.crcErrors[chip];
+      }
+      hiCRCErr->SetEntries(nErrors);
+
+      // the channel hits of all chips
+      chipHistos.flush();
+      uint64_t chanFrames = chipHistos.frames();
+      uint64_t notFired = 0;
+      for (int chan = 0; chan < 128; ++chan) {
+        uint64_t chanFired = chipHistos.total(chan);
+        histos[chan]->SetBinContent(histos[chan]->FindFixBin(0.), chanFrames - chanFired);
+        histos[chan]->SetBinContent(histos[chan]->FindFixBin(1.), chanFired);
+        histos[chan]->SetEntries(chanFrames);
+        hiCh128->SetBinContent(chan+1, chanFrames - chanFired);
+        notFired += chanFrames - chanFired;
+      }
+      hiCh128->SetEntries(notFired);
+  };
+
   const Int_t ieventPrint = 3;
   const Int_t ieventMax   = 9000000;
   const Int_t kUPDATE     = 10;
 
-    Event *ev = new Event(); 
-    GEMtree.Branch("GEMEvents", &ev);
-
+    // GEMEvents, and the columnar copy split so that every EventFlat vector is a branch of its own,
+    // filled here or on the writer thread, --write async keeps up to 64 entries in flight
+    GEMEventWriter writer(fullTree ? &GEMtree : 0, flatTree ? &GEMflat : 0, treeSettings, writeMode == "async" ? 64 : 0);
+    Event *ev = 0;
+    EventFlat *flat = 0;
+    // GEMtree entries of every chamber and, for AMC input, the (LV1ID, BXID) index, for GEMEventLookup
+    GEMChamberIndex chamberIndex;
+    Long64_t nEntries = 0;
+
+  // the decoding thread publishes snapshots of the histograms every refreshMs, this thread draws them
+  GEMDisplay display(c1, refreshMs);
+  display.add(1, hiVFAT, true);
+  display.add(2, hi1010);
+  display.add(3, hi1100);
+  display.add(4, hiFlag, true);
+  display.add(5, hi1110, true);
+  display.add(6, hiChip, true);
+  display.add(7, hiCRC, true);
+  display.add(8, hiCh128, true);
+  display.add(9, hiCRCErr);
+
+  int lastPublished = 0;
+  auto decode = [&](){
   for(int ievent=0; ievent<ieventMax; ievent++){
-    if(inpf.eof()) break;
-    if(!inpf.good()) break;
+    if(select){
+      if(ievent >= (int)selected.size()) break;
+      idxf.seekEntry(selected[ievent]);
+    }
+    if(!follow && !multiInput && (binaryInput ? !binf.good() : !inpf.good())) break;
 
     if(ievent <= ieventPrint) cout << "\nievent " << ievent << endl;
 
-    // read Event Chamber Header 
-    Online.readGEBheader(inpf, geb);
-    if(ievent <= ieventPrint) Online.printGEBheader(geb);
-
-    uint64_t ZSFlag  = (0xffffff0000000000 & geb.header) >> 40; 
-    uint64_t ChamID  = (0x000000fff0000000 & geb.header) >> 28; 
-    uint64_t sumVFAT = (0x000000000fffffff & geb.header);
-
-    GEBdata *GEBdata_ = new GEBdata(ZSFlag, ChamID);
-
-    for(int ivfat=0; ivfat<sumVFAT; ivfat++){
-      Online.readEvent(inpf, ievent, vfat);
-
-      uint8_t   b1010  = (0xf000 & vfat.BC) >> 12;
-      uint8_t   b1100  = (0xf000 & vfat.EC) >> 12;
-      uint8_t   Flag   = (0x000f & vfat.EC);
-      uint8_t   b1110  = (0xf000 & vfat.ChipID) >> 12;
-      uint16_t  ChipID = (0x0fff & vfat.ChipID);
-      uint16_t  CRC    = vfat.crc;
-
-     VFATdata *VFATdata_ = new VFATdata(b1010, b1100, Flag, b1110, ChipID, CRC);
-     GEBdata_->addVFATData(*VFATdata_);
-     delete VFATdata_;
-
-     /*
-      * GEM Event Analyse
-      */
-
-      hiVFAT->Fill(ivfat);
-      hi1010->Fill(b1010);
-      hi1100->Fill(b1100);
-      hiFlag->Fill(Flag);
-      hi1110->Fill(b1110);
-      if (ChipID != 0xdead) hiChip->Fill(ChipID);
-      hiCRC->Fill(CRC);
-
-      //I think it would be nice to time this...
-      uint8_t chan0xf = 0;
-      for (int chan = 0; chan < 128; ++chan) {
-        if (chan < 64){
-          chan0xf = ((vfat.lsData >> chan) & 0x1);
-  	  histos[chan]->Fill(chan0xf);
-	  if(!chan0xf) hiCh128->Fill(chan);
-	} else {
-          chan0xf = ((vfat.lsData >> (chan-64)) & 0x1);
-  	  histos[chan]->Fill(chan0xf);
-	  if(!chan0xf) hiCh128->Fill(chan);
-        }
-      }
-
-      if(ievent <= ieventPrint){
-	Online.printVFATdataBits(ievent, ivfat, vfat);
-        //Online.printVFATdata(ievent, vfat);
-        //Online.PrintChipID(ievent,vfat);
+    // read the AMC record, or one Event Chamber Header, VFAT2 frames and Chamber Trailer
+    auto readNext = [&](){
+      if(amcInput) return(binaryInput ? Online.readAMC(binf, ievent, amc) : Online.readAMC(inpf, ievent, amc));
+      return(binaryInput ? Online.readGEB(binf, ievent, amc.gebs[0]) : Online.readGEB(inpf, ievent, amc.gebs[0]));
+    };
+    bool complete;
+    if(multiInput) complete = multi->next(amc.gebs[0]);
+    else           complete = readNext();
+
+    // follow mode: the record is not fully written yet, readGEB left the stream at its start, wait for the DAQ
+    int idleMs = 0;
+    while(!complete && follow){
+      if(lastPublished != ievent){
+        display.publish(fillHistograms);
+        lastPublished = ievent;
       }
+      if(idleSec > 0 && idleMs >= 1000*idleSec) break;
+      gSystem->Sleep(pollMs);
+      idleMs += pollMs;
+      if(binaryInput) binf.refresh();
+      complete = readNext();
     }
+    if(!complete) break;
+    if(amcInput && ievent <= ieventPrint) Online.printAMCheader(amc);
+
+    // the Event, its GEBdata and their vfats are recycled, no allocation per event
+    writer.next(ev, flat);
+    ev->Build(GEMBits::AMCHeader1::AmcNo::get(amc.header1), GEMBits::AMCHeader1::LV1ID::get(amc.header1),
+              GEMBits::AMCHeader1::BXID::get(amc.header1), GEMBits::AMCHeader1::DataLgth::get(amc.header1),
+              GEMBits::AMCHeader2::OrN::get(amc.header2), GEMBits::AMCHeader2::BoardID::get(amc.header2),   // BoardID:16 into the char of Event
+              GEMBits::AMCHeader3::DAVList::get(amc.header3), GEMBits::AMCHeader3::BufStat::get(amc.header3),
+              GEMBits::AMCHeader3::DAVCount::get(amc.header3), GEMBits::AMCHeader3::FormatVer::get(amc.header3),
+              GEMBits::AMCHeader3::MP7BordStat::get(amc.header3),
+              GEMBits::AMCTrailer2::EventStat::get(amc.trailer2), GEMBits::AMCTrailer2::GEBerrFlag::get(amc.trailer2),
+              GEMBits::AMCTrailer1::crc::get(amc.trailer1), GEMBits::AMCTrailer1::LV1IDT::get(amc.trailer1),
+              GEMBits::AMCTrailer1::DataLgth::get(amc.trailer1));
+
+    for(size_t igeb = 0; igeb < amc.gebs.size(); ++igeb){
+      const GEMOnline::GEBData& geb = amc.gebs[igeb];
+      if(ievent <= ieventPrint) Online.printGEBheader(geb);
+
+      uint64_t ZSFlag  = GEMBits::GEBHeader::ZSFlag::get(geb.header); 
+      uint64_t ChamID  = GEMBits::GEBHeader::ChamID::get(geb.header); 
+      uint64_t sumVFAT = GEMBits::GEBHeader::SumVFAT::get(geb.header);
+
+      GEBdata& GEBdata_ = ev->newGEBdata(ZSFlag, ChamID);
+      if(fullTree) chamberIndex.enter(ChamID, nEntries);
+      if(flatTree) flat->addGEB(ZSFlag, ChamID);
+
+      for(int ivfat=0; ivfat<sumVFAT; ivfat++){
+        const GEMOnline::VFATData& vfat = geb.vfats[ivfat];
+
+        uint8_t   b1010  = GEMBits::VFAT::Control::get(vfat.BC);
+        uint8_t   b1100  = GEMBits::VFAT::Control::get(vfat.EC);
+        uint8_t   Flag   = GEMBits::VFAT::Flag::get(vfat.EC);
+        uint8_t   b1110  = GEMBits::VFAT::Control::get(vfat.ChipID);
+        uint16_t  ChipID = GEMBits::VFAT::ChipID::get(vfat.ChipID);
+        uint16_t  CRC    = vfat.crc;
+
+       VFATdata VFATdata_(b1010, b1100, ChipID, Flag, b1110, CRC, vfat.lsData, vfat.msData);
+       VFATdata_.setCrcOK(vfat.crcOK);
+       GEBdata_.addVFATData(VFATdata_);
+       if(flatTree) flat->addVFAT(GEMBits::VFAT::BC::get(vfat.BC), GEMBits::VFAT::EC::get(vfat.EC), Flag, ChipID, CRC, vfat.crcOK, vfat.lsData, vfat.msData);
+
+        if(ievent <= ieventPrint){
+          Online.printVFATdataBits(ievent, ivfat, vfat);
+          //Online.printVFATdata(ievent, vfat);
+          //Online.PrintChipID(ievent,vfat);
+        }
+      }
 
-    // read Event Chamber Header 
-    Online.readGEBtrailer(inpf, geb);
+      /*
+       * GEM Event Analyse, multi counts the records of several inputs
+       */
+      if(!multi) dqm.addGEB(geb);
 
-    uint64_t OHcrc      = (0xffff000000000000 & geb.trailer) >> 48; 
-    uint64_t OHwCount   = (0x0000ffff00000000 & geb.trailer) >> 32; 
-    uint64_t ChamStatus = (0x00000000ffff0000 & geb.trailer) >> 16;
+      uint64_t OHcrc      = GEMBits::GEBTrailer::OHcrc::get(geb.trailer); 
+      uint64_t OHwCount   = GEMBits::GEBTrailer::OHwCount::get(geb.trailer); 
+      uint64_t ChamStatus = GEMBits::GEBTrailer::ChamStatus::get(geb.trailer);
 
-    GEBdata_->setTrailer(OHcrc, OHwCount, ChamStatus);
+      GEBdata_.setTrailer(OHcrc, OHwCount, ChamStatus);
 
-    ev->Build(0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0);
-    ev->addGEBdata(*GEBdata_);
-    GEMtree.Fill();
-    ev->Clear();
+      if(flatTree) flat->setTrailer(OHcrc, OHwCount, ChamStatus);
 
-    if(ievent <= ieventPrint){
-      cout << "GEM Camber Treiler: OHcrc " << hex << OHcrc << " OHwCount " << OHwCount << " ChamStatus " << ChamStatus << dec 
-           << " ievent " << ievent << endl;
+      if(ievent <= ieventPrint){
+        cout << "GEM Camber Treiler: OHcrc " << hex << OHcrc << " OHwCount " << OHwCount << " ChamStatus " << ChamStatus << dec 
+             << " ievent " << ievent << endl;
+      }
     }
+    writer.fill();
+    nEntries++;
 
-    if (ievent%kUPDATE == 0 && ievent != 0) {
+    // the clock is looked at every kUPDATE events
+    if (ievent%kUPDATE == 0 && ievent != 0 && display.due()) {
       if(ievent < ieventPrint) cout << "event " << ievent << " ievent%kUPDATE " << ievent%kUPDATE << endl;
-      c1->cd(1)->SetLogy(); hiVFAT->Draw();
-      c1->cd(2); hi1010->Draw();
-      c1->cd(3); hi1100->Draw();
-      c1->cd(4)->SetLogy(); hiFlag->Draw();
-      c1->cd(5)->SetLogy(); hi1110->Draw();
-      c1->cd(6)->SetLogy(); hiChip->Draw();
-      c1->cd(7)->SetLogy(); hiCRC->Draw();
-      c1->cd(8)->SetLogy(); hiCh128->Draw();
-      c1->Update();
+      display.publish(fillHistograms);
+      lastPublished = ievent;
     }
 
   cout<<"ievent "<< ievent <<endl;
   }
-  inpf.close();
+  };
+
+  if(display.enabled()){
+    std::thread decoder([&]{ decode(); display.finish(); });
+    display.run();
+    decoder.join();
+    cout << display.snapshots() << " snapshots drawn every " << refreshMs << " ms" << endl;
+  }
+  else decode();
+  if(multi) multi->finish();
+  fillHistograms();
+
+  // damaged input skipped by the frame scanner
+  uint64_t skippedBytes = multi ? multi->skippedBytes() : Online.skippedBytes;
+  uint64_t resyncs      = multi ? multi->resyncs()      : Online.resyncs;
+  if(!multiInput && binaryInput && binf.tell() < binf.getEnd()) cout << "\n" << binf.getEnd() - binf.tell() << " bytes at the end are not a complete " << (amcInput ? "AMC" : "GEB") << " record" << endl;
+  if(resyncs) cout << "\nResynchronised " << resyncs << " times on damaged input, " << skippedBytes << " bytes skipped" << endl;
+
+  // CRC-16 summary, chips with errors only
+  for(int chip = 0; chip < 0x1000; ++chip){
+    if(dqm.crcErrors[chip] == 0) continue;
+    cout << "ChipID 0x" << hex << chip << dec << " CRC errors " << dqm.crcErrors[chip] << " of " << dqm.crcFrames[chip] << " frames" << endl;
+  }
 
-  // Save all objects in this file
+  inpf.close();
+  binfile.close();
+  delete multi;
+  blockf.close();
+
+  // Save all objects in this file, once the writer thread has filled the last entries
+  writer.close();
+  if(fullTree){
+    chamberIndex.write(hfile, &GEMtree, amcInput);
+    cout << "GEMtree index: " << chamberIndex.chambers() << " chambers" << (amcInput ? ", LV1ID BXID" : "") << endl;
+  }
+  display.drawFinal();
+  chipHistos.write(hfile->mkdir("Chips"));
+  cout << "Chips: " << chipHistos.size() << " (ChamID, ChipID) histogram sets" << endl;
   hfile->Write();
   cout<<"=== hfile->Write()"<<endl;
 
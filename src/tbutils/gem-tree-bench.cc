@@ -0,0 +1,241 @@
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <cstdint>
+#include <chrono>
+
+#include <sys/stat.h>
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include "Event.h"
+#include "GEMGEBRecord.h"
+#include "GEMTreeSettings.h"
+#include "GEMBitFields.h"
+/**
+* ... GEMtree output settings benchmark ...
+*/
+
+/*! \file */
+/*!
+  Writes the GEB records of one DataParker.dat (text) or gem-re-write binary
+  file into GEMtree once for every combination of the given output settings,
+  and reads every file back. Reported per setting: write time, events/s and
+  MB/s of the binary GEB records, file size and compression ratio, read-back
+  time and MB/s.
+
+  gem-tree-bench [--binary] [--tree full|flat] [--compression N,N,...] [--basket N,N,...]
+                 [--autoflush N,N,...] [--split N,N,...] [--repeat N] [--out file] input
+
+  The records are decoded into memory first, so only filling, compression and
+  writing are timed. --compression takes 100*algorithm + level as
+  gem-reading --compression: 1xx zlib, 2xx lzma, 4xx lz4, 5xx zstd, 0 none.
+*/
+
+using namespace std;
+
+//! Size of a file in bytes, 0 if it can not be read.
+static uint64_t fileSize(const string& file){
+  struct stat st;
+  return (stat(file.c_str(), &st) == 0) ? st.st_size : 0;
+}
+
+//! Comma separated list of numbers.
+static vector<long> numberList(const string& s){
+  vector<long> v;
+  size_t pos = 0;
+  while(pos < s.size()){
+    size_t comma = s.find(',', pos);
+    if(comma == string::npos) comma = s.size();
+    v.push_back(strtol(s.substr(pos, comma - pos).c_str(), 0, 0));
+    pos = comma + 1;
+  }
+  return v;
+}
+
+static double seconds(std::chrono::steady_clock::time_point t0){
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return(sec > 0 ? sec : 1.e-9);
+}
+
+//! Fill the tree as gem-reading.cc does, returns the write time including Write() and Close().
+static double writeTree(const vector<GEMGEBRecord::GEBData>& gebs, const GEMTreeSettings& settings, bool flatTree, const string& output){
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  TFile* hfile = new TFile(output.c_str(), "RECREATE", "GEMtree output settings benchmark");
+  settings.apply(hfile);
+  TTree* tree = flatTree ? new TTree("GEMflat", "GEM Events, one branch per VFAT2 field")
+                         : new TTree("GEMtree", "A Tree with GEM Events");
+  settings.apply(*tree);
+
+  Event *ev = new Event();
+  EventFlat *flat = new EventFlat();
+  if(flatTree) tree->Branch("GEMFlat.", &flat, settings.basketSize, 99);
+  else         tree->Branch("GEMEvents", &ev, settings.basketSize, settings.splitLevel);
+
+  for(size_t i = 0; i < gebs.size(); ++i){
+    const GEMGEBRecord::GEBData& geb = gebs[i];
+    uint64_t ZSFlag     = GEMBits::GEBHeader::ZSFlag::get(geb.header);
+    uint64_t ChamID     = GEMBits::GEBHeader::ChamID::get(geb.header);
+    uint64_t OHcrc      = GEMBits::GEBTrailer::OHcrc::get(geb.trailer);
+    uint64_t OHwCount   = GEMBits::GEBTrailer::OHwCount::get(geb.trailer);
+    uint64_t ChamStatus = GEMBits::GEBTrailer::ChamStatus::get(geb.trailer);
+
+    if(flatTree){
+      flat->addGEB(ZSFlag, ChamID);
+      for(size_t ivfat = 0; ivfat < geb.vfats.size(); ++ivfat){
+        const GEMGEBRecord::VFATData& vfat = geb.vfats[ivfat];
+        flat->addVFAT(GEMBits::VFAT::BC::get(vfat.BC), GEMBits::VFAT::EC::get(vfat.EC), GEMBits::VFAT::Flag::get(vfat.EC), GEMBits::VFAT::ChipID::get(vfat.ChipID), vfat.crc, false, vfat.lsData, vfat.msData);
+      }
+      flat->setTrailer(OHcrc, OHwCount, ChamStatus);
+      tree->Fill();
+      flat->Clear();
+    } else {
+      ev->Build(0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0);
+      GEBdata& GEBdata_ = ev->newGEBdata(ZSFlag, ChamID);
+      for(size_t ivfat = 0; ivfat < geb.vfats.size(); ++ivfat){
+        const GEMGEBRecord::VFATData& vfat = geb.vfats[ivfat];
+        VFATdata VFATdata_(GEMBits::VFAT::Control::get(vfat.BC), GEMBits::VFAT::Control::get(vfat.EC), GEMBits::VFAT::ChipID::get(vfat.ChipID), GEMBits::VFAT::Flag::get(vfat.EC),
+                           GEMBits::VFAT::Control::get(vfat.ChipID), vfat.crc, vfat.lsData, vfat.msData);
+        GEBdata_.addVFATData(VFATdata_);
+      }
+      GEBdata_.setTrailer(OHcrc, OHwCount, ChamStatus);
+      tree->Fill();
+      ev->Clear();
+    }
+  }
+
+  hfile->Write();
+  hfile->Close();
+  delete hfile;
+  delete ev;
+  delete flat;
+  return(seconds(t0));
+}
+
+//! Read every entry back, returns the read time, -1 if the tree is missing.
+static double readTree(bool flatTree, const string& output, Long64_t& entries){
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  TFile* hfile = TFile::Open(output.c_str());
+  if(!hfile || hfile->IsZombie()) return(-1);
+  TTree* tree = 0;
+  hfile->GetObject(flatTree ? "GEMflat" : "GEMtree", tree);
+  if(!tree){ delete hfile; return(-1); }
+  Event *ev = 0;
+  EventFlat *flat = 0;
+  if(flatTree) tree->SetBranchAddress("GEMFlat.", &flat);
+  else         tree->SetBranchAddress("GEMEvents", &ev);
+  entries = tree->GetEntries();
+  for(Long64_t i = 0; i < entries; ++i) tree->GetEntry(i);
+  hfile->Close();
+  delete hfile;
+  delete ev;
+  delete flat;
+  return(seconds(t0));
+}
+
+//! main function.
+/*!
+C++ any documents
+*/
+
+int main(int argc, char** argv)
+{
+  bool binaryInput = false;                 // --binary : file written by gem-re-write/gem-convert
+  string treeType  = "full";                // --tree full|flat : GEMtree or GEMflat
+  string output    = "gem-tree-bench.root"; // --out file : overwritten for every setting
+  int repeat       = 1;                     // --repeat N : best of N writes and reads
+  vector<long> compressions = numberList("0,101,106,109,401,404,409,505,509,209");
+  vector<long> baskets      = numberList("32000");
+  vector<long> autoflushes  = numberList("-30000000");
+  vector<long> splits       = numberList("99");
+  string file;
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if      (arg == "--binary")                  binaryInput = true;
+    else if (arg == "--tree"        && i+1<argc) treeType    = argv[++i];
+    else if (arg == "--out"         && i+1<argc) output      = argv[++i];
+    else if (arg == "--repeat"      && i+1<argc) repeat      = atoi(argv[++i]);
+    else if (arg == "--compression" && i+1<argc) compressions = numberList(argv[++i]);
+    else if (arg == "--basket"      && i+1<argc) baskets      = numberList(argv[++i]);
+    else if (arg == "--autoflush"   && i+1<argc) autoflushes  = numberList(argv[++i]);
+    else if (arg == "--split"       && i+1<argc) splits       = numberList(argv[++i]);
+    else if (arg.size() && arg[0]!='-' && file.empty()) file = arg;
+    else {
+      cout << "unknown option " << arg << endl;
+      return 1;
+    }
+  }
+  if(file.empty() || (treeType != "full" && treeType != "flat") || repeat < 1 ||
+     compressions.empty() || baskets.empty() || autoflushes.empty() || splits.empty()) {
+    cout << "usage: gem-tree-bench [--binary] [--tree full|flat] [--compression N,N,...] [--basket N,N,...]\n"
+         << "                      [--autoflush N,N,...] [--split N,N,...] [--repeat N] [--out file] input" << endl;
+    return 1;
+  }
+  bool flatTree = (treeType == "flat");
+
+  // decode the input once, only the tree output is timed
+  vector<GEMGEBRecord::GEBData> gebs;
+  uint64_t nVFAT = 0;
+  {
+    GEMHexReader inpf;
+    GEMBinaryReader binf;
+    if(binaryInput ? !binf.open(file) : !inpf.open(file)) {
+      cout << "\nThe file: " << file << " is missing.\n" << endl;
+      return 1;
+    };
+    for(;;){
+      GEMGEBRecord::GEBData geb;
+      if(binaryInput ? !binf.good() : !inpf.good()) break;
+      if(!(binaryInput ? GEMGEBRecord::readGEB(binf, geb) : GEMGEBRecord::readGEB(inpf, geb))) break;
+      nVFAT += geb.vfats.size();
+      gebs.push_back(geb);
+    }
+  }
+  // payload: the binary GEB records
+  double MB = (gebs.size()*(GEMBinaryReader::kGEBheaderSize + GEMBinaryReader::kGEBtrailerSize) + nVFAT*GEMBinaryReader::kVFATSize)/1.e6;
+  cout << file << ": " << gebs.size() << " GEB records, " << nVFAT << " VFAT2 frames, "
+       << setprecision(3) << MB << " MB binary, " << (flatTree ? "GEMflat" : "GEMtree") << endl;
+  if(gebs.empty()) return 1;
+
+  cout << "\n" << left << setw(44) << "settings"
+       << right << setw(9) << "write s" << setw(10) << "events/s" << setw(9) << "MB/s"
+       << setw(10) << "file MB" << setw(8) << "ratio" << setw(9) << "read s" << setw(9) << "MB/s" << endl;
+
+  for(size_t c = 0; c < compressions.size(); ++c)
+  for(size_t b = 0; b < baskets.size(); ++b)
+  for(size_t a = 0; a < autoflushes.size(); ++a)
+  for(size_t s = 0; s < splits.size(); ++s){
+    GEMTreeSettings settings;
+    settings.setCompression(compressions[c]);
+    settings.basketSize = baskets[b];
+    settings.autoFlush  = autoflushes[a];
+    settings.splitLevel = splits[s];
+
+    double wsec = 0, rsec = 0;
+    Long64_t entries = 0;
+    for(int r = 0; r < repeat; ++r){
+      double w = writeTree(gebs, settings, flatTree, output);
+      double t = readTree(flatTree, output, entries);
+      if(t < 0){
+        cout << "\nThe file: " << output << " has no tree.\n" << endl;
+        return 2;
+      }
+      if(r == 0 || w < wsec) wsec = w;
+      if(r == 0 || t < rsec) rsec = t;
+    }
+    double size = fileSize(output)/1.e6;
+    cout << left << setw(44) << settings.describe() << right << fixed << setprecision(3)
+         << setw(9) << wsec << setw(10) << setprecision(0) << gebs.size()/wsec
+         << setw(9) << setprecision(1) << MB/wsec << setw(10) << setprecision(3) << size
+         << setw(8) << setprecision(2) << (size > 0 ? MB/size : 0.)
+         << setw(9) << setprecision(3) << rsec << setw(9) << setprecision(1) << MB/rsec << endl;
+    cout.unsetf(ios::fixed);
+    if(entries != (Long64_t)gebs.size()) cout << "  read back " << entries << " of " << gebs.size() << " entries" << endl;
+  }
+  return 0;
+}
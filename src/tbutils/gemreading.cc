@@ -22,6 +22,9 @@
 #include <TApplication.h>
 #include <TString.h>
 
+#include "GEMHexReader.h"
+#include "GEMBitFields.h"
+
 /**
 * ... Threshold Scan ROOT based application, could be used for analisys of XDAQ GEM data ...
 */
@@ -137,22 +140,22 @@ class GEMOnline {
         if( event<0) return(false);
 	cout << "\nReceived VFAT data word: event " << event << " ivfat  " << ivfat << endl;
   
-          uint8_t   b1010 = (0xf000 & vfat.BC) >> 12;
-          show4bits(b1010); cout << " BC     0x" << hex << (0x0fff & vfat.BC) << dec << endl;
+          uint8_t   b1010 = GEMBits::VFAT::Control::get(vfat.BC);
+          show4bits(b1010); cout << " BC     0x" << hex << GEMBits::VFAT::BC::get(vfat.BC) << dec << endl;
   
-          uint8_t   b1100 = (0xf000 & vfat.EC) >> 12;
-          uint16_t   EC   = (0x0ff0 & vfat.EC) >> 4;
-          uint8_t   Flag  = (0x000f & vfat.EC);
+          uint8_t   b1100 = GEMBits::VFAT::Control::get(vfat.EC);
+          uint16_t   EC   = GEMBits::VFAT::EC::get(vfat.EC);
+          uint8_t   Flag  = GEMBits::VFAT::Flag::get(vfat.EC);
           show4bits(b1100); cout << " EC     0x" << hex << EC << dec << endl; 
           show4bits(Flag);  cout << " Flags " << endl;
   
-          uint8_t   b1110 = (0xf000 & vfat.ChipID) >> 12;
-          uint16_t ChipID = (0x0fff & vfat.ChipID);
+          uint8_t   b1110 = GEMBits::VFAT::Control::get(vfat.ChipID);
+          uint16_t ChipID = GEMBits::VFAT::ChipID::get(vfat.ChipID);
           show4bits(b1110); cout << " ChipID 0x" << hex << ChipID << dec << " " << endl;
 	  /*
           cout << "     bxExp  0x" << std::setfill('0') << std::setw(4) << hex << vfat.bxExp << dec << " " << endl;
-  	  cout << "     bxNum  0x" << std::setfill('0') << std::setw(2) << hex << ((0xff00 & vfat.bxNum) >> 8) << dec << endl;
-  	  cout << "     SBit   0x" << std::setfill('0') << std::setw(2) << hex <<  (0x00ff & vfat.bxNum)       << dec << endl;
+  	  cout << "     bxNum  0x" << std::setfill('0') << std::setw(2) << hex << GEMBits::VFAT::BxNum::get(vfat.bxNum) << dec << endl;
+  	  cout << "     SBit   0x" << std::setfill('0') << std::setw(2) << hex <<  GEMBits::VFAT::SBit::get(vfat.bxNum)       << dec << endl;
 	  */
           cout << " <127:64>:: 0x" << std::setfill('0') << std::setw(8) << hex << vfat.msData << dec << endl;
           cout << " <63:0>  :: 0x" << std::setfill('0') << std::setw(8) << hex << vfat.lsData << dec << endl;
@@ -171,9 +174,9 @@ class GEMOnline {
       bool PrintChipID(int event, const VFATData& vfat){
         if( event<0 ) return(false);
           cout << "\nevent " << event << endl;
-          uint8_t bitsE = ((vfat.ChipID&0xF000)>>12);
+          uint8_t bitsE = GEMBits::VFAT::Control::get(vfat.ChipID);
           showbits(bitsE);
-          cout << hex << "1110 0x0" << ((vfat.ChipID&0xF000)>>12) << " ChipID 0x" << (vfat.ChipID&0x0FFF) << dec << endl;
+          cout << hex << "1110 0x0" << GEMBits::VFAT::Control::get(vfat.ChipID) << " ChipID 0x" << GEMBits::VFAT::ChipID::get(vfat.ChipID) << dec << endl;
       };
     
       //! showbits function.
@@ -188,14 +191,12 @@ class GEMOnline {
           printf("\n");
         };
 
-      bool readGEBheader(ifstream& inpf, GEBData& geb){
-	inpf >> geb.header;
-        return(true);
+      bool readGEBheader(GEMHexReader& inpf, GEBData& geb){
+        return(inpf.readHex(geb.header));
       };	  
 
-      bool readGEBtrailer(ifstream& inpf, GEBData& geb){
- 	inpf >> geb.trailer;
-        return(true);
+      bool readGEBtrailer(GEMHexReader& inpf, GEBData& geb){
+        return(inpf.readHex(geb.trailer));
       };	  
 
   //! Read 1-128 channels data
@@ -208,19 +209,19 @@ class GEMOnline {
         reading GEM VFAT2 data (BC,EC,bxNum,ChipID,(lsData & msData), crc.
        */
     
-      bool readEvent(ifstream& inpf, int event, VFATData& vfat){
+      bool readEvent(GEMHexReader& inpf, int event, VFATData& vfat){
         if(event<0) return(false);
-          inpf >> hex >> vfat.BC;
-          inpf >> hex >> vfat.EC;
-          /* inpf >> hex >> vfat.bxExp;
-          inpf >> hex >> vfat.bxNum;
+          inpf.readHex(vfat.BC);
+          inpf.readHex(vfat.EC);
+          /* inpf.readHex(vfat.bxExp);
+          inpf.readHex(vfat.bxNum);
           */
-	  inpf >> hex >> vfat.ChipID;
-          inpf >> hex >> vfat.lsData;
-          inpf >> hex >> vfat.msData;
-          inpf >>        vfat.delVT;
-          inpf >> hex >> vfat.crc;
-        return(true);
+	  inpf.readHex(vfat.ChipID);
+          inpf.readHex(vfat.lsData);
+          inpf.readHex(vfat.msData);
+          inpf.readDouble(vfat.delVT);
+          inpf.readHex(vfat.crc);
+        return(!inpf.fail());
       };	  
 };
 
@@ -253,8 +254,8 @@ TFile* thldread(Int_t get=0)
   int ieventPrint = 30;
   string file="DataParker.dat";
 
-  ifstream inpf(file.c_str());
-  if(!inpf.is_open()) {
+  GEMHexReader inpf;
+  if(!inpf.open(file)) {
     cout << "\nThe file: " << file.c_str() << " is missing.\n" << endl;
     return 0;
   };
@@ -301,15 +302,14 @@ TFile* thldread(Int_t get=0)
   const Int_t kUPDATE = 100;
 
   for(int ievent=0; ievent<ieventMax; ievent++){
-    if(inpf.eof()) break;
     if(!inpf.good()) break;
 
     // read Event Chamber Header 
     data.readGEBheader(inpf, geb);
   
-    uint64_t ZSFlag  = (0xffffff0000000000 & geb.header) >> 40; 
-    uint64_t ChamID  = (0x000000fff0000000 & geb.header) >> 28; 
-    uint64_t sumVFAT = (0x000000000fffffff & geb.header);
+    uint64_t ZSFlag  = GEMBits::GEBHeader::ZSFlag::get(geb.header); 
+    uint64_t ChamID  = GEMBits::GEBHeader::ChamID::get(geb.header); 
+    uint64_t sumVFAT = GEMBits::GEBHeader::SumVFAT::get(geb.header);
 
     cout << " ievent " << ievent << endl;
     cout << hex << " GEM Camber Header " << " ZSFlag " << ZSFlag << " ChamID " << ChamID << dec << " sumVFAT " << sumVFAT << endl;
@@ -327,9 +327,9 @@ TFile* thldread(Int_t get=0)
     // read Event Chamber Header 
     data.readGEBtrailer(inpf, geb);
 
-    uint64_t OHcrc      = (0xffff000000000000 & geb.trailer) >> 48; 
-    uint64_t OHwCount   = (0x0000ffff00000000 & geb.trailer) >> 32; 
-    uint64_t ChamStatus = (0x00000000ffff0000 & geb.trailer) >> 16;
+    uint64_t OHcrc      = GEMBits::GEBTrailer::OHcrc::get(geb.trailer); 
+    uint64_t OHwCount   = GEMBits::GEBTrailer::OHwCount::get(geb.trailer); 
+    uint64_t ChamStatus = GEMBits::GEBTrailer::ChamStatus::get(geb.trailer);
 
     cout << " GEM Camber Treiler: OHcrc " << hex << OHcrc << " OHwCount " << OHwCount << " ChamStatus " << ChamStatus << dec << endl;
 
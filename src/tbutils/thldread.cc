@@ -7,6 +7,11 @@
 #include <sstream>
 #include <vector>
 #include <cstdint>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 
 #include <TFile.h>
 #include <TNtuple.h>
@@ -15,6 +20,10 @@
 #include <TCanvas.h>
 #include <TFrame.h>
 #include <TROOT.h>
+#include <RVersion.h>
+#if ROOT_VERSION_CODE < ROOT_VERSION(6,0,0)
+#include <TThread.h>
+#endif
 #include <TSystem.h>
 #include <TRandom3.h>
 #include <TBenchmark.h>
@@ -22,6 +31,13 @@
 #include <TApplication.h>
 #include <TString.h>
 
+#include "GEMHexReader.h"
+#include "GEMBitFields.h"
+#include "GEMScanCounter.h"
+#include "GEMThreadCounts.h"
+#include "GEMSCurveFit.h"
+#include "GEMDisplay.h"
+
 /**
 * ... Threshold Scan ROOT based application, could be used for analisys of XDAQ GEM data ...
 */
@@ -131,22 +147,22 @@ class GEMData {
         if( event<0) return(false);
 	  cout << "\nReceived VFAT data word: event " << event << endl;
   
-          uint8_t   b1010 = (0xf000 & vfat.BC) >> 12;
-          show4bits(b1010); cout << " BC     0x" << hex << (0x0fff & vfat.BC) << dec << endl;
+          uint8_t   b1010 = GEMBits::VFAT::Control::get(vfat.BC);
+          show4bits(b1010); cout << " BC     0x" << hex << GEMBits::VFAT::BC::get(vfat.BC) << dec << endl;
   
-          uint8_t   b1100 = (0xf000 & vfat.EC) >> 12;
-          uint16_t   EC   = (0x0ff0 & vfat.EC) >> 4;
-          uint8_t   Flag  = (0x000f & vfat.EC);
+          uint8_t   b1100 = GEMBits::VFAT::Control::get(vfat.EC);
+          uint16_t   EC   = GEMBits::VFAT::EC::get(vfat.EC);
+          uint8_t   Flag  = GEMBits::VFAT::Flag::get(vfat.EC);
           show4bits(b1100); cout << " EC     0x" << hex << EC << dec << endl; 
           show4bits(Flag);  cout << " Flags " << endl;
   
-          uint8_t   b1110 = (0xf000 & vfat.ChipID) >> 12;
-          uint16_t ChipID = (0x0fff & vfat.ChipID);
+          uint8_t   b1110 = GEMBits::VFAT::Control::get(vfat.ChipID);
+          uint16_t ChipID = GEMBits::VFAT::ChipID::get(vfat.ChipID);
           show4bits(b1110); cout << " ChipID 0x" << hex << ChipID << dec << " " << endl;
   
           cout << "     bxExp  0x" << std::setfill('0') << std::setw(4) << hex << vfat.bxExp << dec << " " << endl;
-  	  cout << "     bxNum  0x" << std::setfill('0') << std::setw(2) << hex << ((0xff00 & vfat.bxNum) >> 8) << dec << endl;
-  	  cout << "     SBit   0x" << std::setfill('0') << std::setw(2) << hex <<  (0x00ff & vfat.bxNum)       << dec << endl;
+  	  cout << "     bxNum  0x" << std::setfill('0') << std::setw(2) << hex << GEMBits::VFAT::BxNum::get(vfat.bxNum) << dec << endl;
+  	  cout << "     SBit   0x" << std::setfill('0') << std::setw(2) << hex <<  GEMBits::VFAT::SBit::get(vfat.bxNum)       << dec << endl;
           cout << " <127:64>:: 0x" << std::setfill('0') << std::setw(8) << hex << vfat.msData << dec << endl;
           cout << " <63:0>  :: 0x" << std::setfill('0') << std::setw(8) << hex << vfat.lsData << dec << endl;
           cout << "     crc    0x" << hex << vfat.crc << dec << endl;
@@ -164,9 +180,9 @@ class GEMData {
       bool PrintChipID(int event, const VFATData& vfat){
         if( event<0 ) return(false);
           cout << "\nevent " << event << endl;
-          uint8_t bitsE = ((vfat.ChipID&0xF000)>>12);
+          uint8_t bitsE = GEMBits::VFAT::Control::get(vfat.ChipID);
           showbits(bitsE);
-          cout << hex << "1110 0x0" << ((vfat.ChipID&0xF000)>>12) << " ChipID 0x" << (vfat.ChipID&0x0FFF) << dec << endl;
+          cout << hex << "1110 0x0" << GEMBits::VFAT::Control::get(vfat.ChipID) << " ChipID 0x" << GEMBits::VFAT::ChipID::get(vfat.ChipID) << dec << endl;
       };
     
       //! Read 1-128 channels data
@@ -179,18 +195,18 @@ class GEMData {
         reading GEM VFAT2 data (BC,EC,bxNum,ChipID,(lsData & msData), crc.
        */
     
-      bool readEvent(ifstream& inpf, int event, VFATData& vfat){
+      bool readEvent(GEMHexReader& inpf, int event, VFATData& vfat){
         if(event<0) return(false);
-          inpf >> hex >> vfat.BC;
-          inpf >> hex >> vfat.EC;
-          inpf >> hex >> vfat.bxExp;
-          inpf >> hex >> vfat.bxNum;
-          inpf >> hex >> vfat.ChipID;
-          inpf >> hex >> vfat.lsData;
-          inpf >> hex >> vfat.msData;
-          inpf >>        vfat.delVT;
-          inpf >> hex >> vfat.crc;
-        return(true);
+          inpf.readHex(vfat.BC);
+          inpf.readHex(vfat.EC);
+          inpf.readHex(vfat.bxExp);
+          inpf.readHex(vfat.bxNum);
+          inpf.readHex(vfat.ChipID);
+          inpf.readHex(vfat.lsData);
+          inpf.readHex(vfat.msData);
+          inpf.readDouble(vfat.delVT);
+          inpf.readHex(vfat.crc);
+        return(!inpf.fail());
       };	  
     
       //! read Threshold scan header.
@@ -198,12 +214,65 @@ class GEMData {
         reading of Threshold Scan setup header
        */
     
-      bool readHeader(ifstream& inpf, AppHeader& ah){
-        inpf >> ah.minTh;
-        inpf >> ah.maxTh;
-        inpf >> ah.stepSize;
-        return(true);
+      bool readHeader(GEMHexReader& inpf, AppHeader& ah){
+        inpf.readDec(ah.minTh);
+        inpf.readDec(ah.maxTh);
+        inpf.readDec(ah.stepSize);
+        return(!inpf.fail());
       };	  
+
+      //! A VFAT2 frame starts at the next token.
+      /*!
+        BC, EC and ChipID carry their control bits 1010, 1100 and 1110, checked for this frame and
+        for the next one unless the data end there.
+       */
+
+      static bool frameAt(GEMHexReader& in){
+        for(int frame = 0; frame < 2; ++frame){
+          if(frame > 0 && !in.good()) return(!in.fail());
+          uint64_t w[5];
+          for(int i = 0; i < 5; ++i) if(!in.readHex(w[i])) return(false);
+          if(w[0] > 0xffff || GEMBits::VFAT::Control::get(uint16_t(w[0])) != GEMBits::VFAT::k1010) return(false);
+          if(w[1] > 0xffff || GEMBits::VFAT::Control::get(uint16_t(w[1])) != GEMBits::VFAT::k1100) return(false);
+          if(w[4] > 0xffff || GEMBits::VFAT::Control::get(uint16_t(w[4])) != GEMBits::VFAT::k1110) return(false);
+          for(int i = 0; i < 4; ++i) if(!in.skipToken()) return(false);
+        }
+        return(true);
+      };
+
+      //! Split the frames for parallel decoding.
+      /*!
+        n byte ranges [cuts[i], cuts[i+1]) from offset first, the start of the first frame, to the end
+        of the file. The writers put one field or one frame per line, so each cut goes forward token
+        by token to the next frameAt(). The decoding threads check that the ranges join up.
+       */
+
+      static std::vector<size_t> splitFrames(const string& file, size_t first, unsigned n){
+        std::ifstream f(file.c_str(), std::ios::binary);
+        f.seekg(0, std::ios::end);
+        size_t size = f ? (size_t)f.tellg() : first;
+        GEMHexReader in;
+        in.open(file);
+        std::vector<size_t> cuts(1, first);
+        for(unsigned i = 1; i < n; ++i){
+          size_t cut = first + (size - first)*i/n;
+          if(cut > cuts.back()){
+            // from the end of the token around cut
+            in.seek(cut - 1);
+            in.skipToken();
+            for(;;){
+              if(!in.good() || in.tell() >= size){ cut = size; break; }
+              cut = in.tell();
+              if(frameAt(in)) break;
+              in.seek(cut);
+              in.skipToken();
+            }
+          }
+          cuts.push_back(std::max(cut, cuts.back()));
+        }
+        cuts.push_back(std::max(size, cuts.back()));
+        return(cuts);
+      };
     
       //! showbits function.
       /*!
@@ -236,19 +305,32 @@ TFile* thldread(Int_t get=0)
 #endif
 { cout<<"---> Main()"<<endl;
 
+  int refreshMs = 1000;         // --refresh N : ms between snapshots of the live canvas, decoding on its own thread, 0 no live canvas
+  unsigned nJobs = std::thread::hardware_concurrency(); // --jobs N : decoding threads, each on its own part of the file
+
 #ifndef __CINT__
+  // our own options, everything else goes to TApplication
+  int appArgc = 1;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if      (arg == "--refresh" && i+1<argc) refreshMs = atoi(argv[++i]);
+    else if (arg == "--jobs"    && i+1<argc) nJobs     = atoi(argv[++i]);
+    else                                     argv[appArgc++] = argv[i];
+  }
+  argc = appArgc;
+
   TApplication App("App", &argc, argv);
 #endif
+  if(nJobs == 0) nJobs = 1;
 
   GEMData data;
-  GEMData::VFATData vfat;
   GEMData::AppHeader  ah;
 
   int ieventPrint = 20;
   string file="ThresholdScan.dat";
 
-  ifstream inpf(file.c_str());
-  if(!inpf.is_open()) {
+  GEMHexReader inpf;
+  if(!inpf.open(file)) {
     cout << "\nThe file: " << file.c_str() << " is missing.\n" << endl;
     return 0;
   };
@@ -295,43 +377,121 @@ TFile* thldread(Int_t get=0)
     histos[hi] = new TH1F(histName.str().c_str(), histTitle.str().c_str(), nBins, (Double_t)ah.minTh-0.5,(Double_t)ah.maxTh+0.5);
   }
 
-  Int_t ieventMax=1000000;
-  const Int_t kUPDATE = 700;
-
-  for(int ievent=0; ievent<ieventMax; ievent++){
-
-    if(inpf.eof()) break;
-    if(!inpf.good()) break;
-
-    data.readEvent(inpf, ievent, vfat);
-
-    // cout << "delVT " << vfat.delVT << " " << dec << (vfat.lsData||vfat.msData) << dec << endl;
+  // the frames are counted per (threshold step, channel), of every chip and of all together, the histograms are set from the
+  // counts when drawn and at the end. Every decoding thread counts its own part of the file, the counts are merged in thread
+  // order, the same for any --jobs
+  GEMScanChips counts(nBins, (Double_t)ah.minTh-0.5, (Double_t)ah.maxTh+0.5);
+  std::vector<size_t> cuts = GEMData::splitFrames(file, inpf.tell(), nJobs);
+  GEMThreadCounts<GEMScanChips> threadCounts(nJobs, counts);
+  inpf.close();
+  cout << "Decoding with " << nJobs << " threads" << endl;
 
-    if(ievent < ieventPrint){
-      data.printVFATdataBits(ievent, vfat);
-      //data.printVFATdata(ievent, vfat);
-      //data.PrintChipID(ievent,vfat);
+  // the decoding thread publishes snapshots of histo every refreshMs, this thread draws them
+  if(refreshMs > 0){
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+    ROOT::EnableThreadSafety();
+#else
+    TThread::Initialize();
+#endif
+  }
+  GEMDisplay display(c1, refreshMs);
+  display.add(1, histo);
+  auto fillDisplay = [&](){ threadCounts.merge(counts); counts.all.fillAny(histo); };
+
+  // thread iworker: the frames of [cuts[iworker], cuts[iworker+1]), the first thread prints the first ones.
+  // Where it stopped and whether a frame failed to read, to check the ranges join up
+  std::atomic<unsigned> running(0);
+  std::vector<size_t> stopAt(threadCounts.threads(), 0);
+  std::vector<char>   failed(threadCounts.threads(), 0);
+  auto decodePart = [&](unsigned iworker){
+    GEMData part;
+    GEMData::VFATData vfat;
+    GEMHexReader in;
+    failed[iworker] = !(in.open(file) && in.seek(cuts[iworker]));
+    if(!failed[iworker]){
+      GEMScanChips& local = threadCounts.local(iworker);
+      for(int ievent=0; ; ievent++){
+
+        // the range ends at the start of a frame, the frame there is the next thread's
+        if(!in.good()){ failed[iworker] = in.fail(); break; }
+        if(in.tell() >= cuts[iworker+1]) break;
+
+        if(!part.readEvent(in, ievent, vfat)){ failed[iworker] = true; break; }
+
+        // cout << "delVT " << vfat.delVT << " " << dec << (vfat.lsData||vfat.msData) << dec << endl;
+
+        if(iworker == 0 && ievent < ieventPrint){
+          part.printVFATdataBits(ievent, vfat);
+          //part.printVFATdata(ievent, vfat);
+          //part.PrintChipID(ievent,vfat);
+        }
+
+        // all 128 channels in one go, instead of histo->Fill and 128 histos[chan]->Fill(vfat.delVT, bit),
+        // the lock is only ever waited for while a snapshot merges the counts
+        std::lock_guard<std::mutex> lock(threadCounts.lock(iworker));
+        local.add(vfat.ChipID, vfat.delVT, vfat.lsData, vfat.msData);
+      }
+      stopAt[iworker] = in.tell();
     }
+    running--;
+  };
 
-    histo->Fill(vfat.delVT, (vfat.lsData||vfat.msData));
-
-    //I think it would be nice to time this...
-    for (int chan = 0; chan < 128; ++chan) {
-      if (chan < 64)
-	histos[chan]->Fill(vfat.delVT,((vfat.lsData>>chan))&0x1);
-      else
-	histos[chan]->Fill(vfat.delVT,((vfat.msData>>(chan-64)))&0x1);
+  // the decoding threads, snapshots of their merged counts every refreshMs
+  auto decodeParts = [&](){
+    std::vector<std::thread> workers;
+    running = cuts.size() - 1;
+    for(unsigned i = 0; i + 1 < cuts.size(); ++i) workers.push_back(std::thread(decodePart, i));
+    while(display.enabled() && running > 0){
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      if(display.due()) display.publish(fillDisplay);
     }
+    for(size_t i = 0; i < workers.size(); ++i) workers[i].join();
+  };
 
-    if (ievent%kUPDATE == 0 && ievent != 0) {
-      if(ievent < ieventPrint) cout << "event " << ievent << " ievent%kUPDATE " << ievent%kUPDATE << endl;
-      c1->cd(1);
-      histo->Draw();
-      c1->Update();
+  // a thread which ended its range anywhere but at the next cut started or stopped inside a frame:
+  // decode the file again in one go. Reading stops at the first bad frame, as it does in one go,
+  // so nothing after it counts
+  auto decode = [&](){
+    decodeParts();
+    for(size_t i = 0; i + 2 < cuts.size(); ++i){
+      if(failed[i] || stopAt[i] == cuts[i+1]) continue;
+      cout << "Thread " << i << " stopped at " << stopAt[i] << " instead of " << cuts[i+1]
+           << ", not a frame boundary, decoding again with one thread" << endl;
+      for(unsigned j = 0; j < threadCounts.threads(); ++j) threadCounts.reset(j);
+      cuts.erase(cuts.begin() + 1, cuts.end() - 1);
+      ieventPrint = 0;
+      decodeParts();
+      break;
+    }
+    for(size_t i = 0; i + 1 < cuts.size(); ++i){
+      if(!failed[i]) continue;
+      for(size_t j = i + 1; j + 1 < cuts.size(); ++j) threadCounts.reset(j);
+      break;
     }
+  };
 
+  if(display.enabled()){
+    std::thread decoder([&]{ decode(); display.finish(); });
+    display.run();
+    decoder.join();
   }
-  inpf.close();
+  else decode();
+
+  threadCounts.merge(counts);
+  counts.all.fillAny(histo);
+  display.drawFinal();
+  for (int chan = 0; chan < 128; ++chan) counts.all.fill(histos[chan], chan);
+
+  // S-curve of every channel of every chip, threshold and noise maps and the fit status into SCurve/
+  GEMSCurveFitter fitter;
+  fitter.fit(counts, nJobs);
+  fitter.write(hfile->mkdir("SCurve"));
+  double meanThreshold, meanNoise, meanIterations;
+  fitter.means(meanThreshold, meanNoise, meanIterations);
+  cout << "S-curve fits: " << fitter.chips() << " chips, " << fitter.chips()*GEMSCurveFitter::kChannels << " channels" << endl;
+  for (int status = 0; status < GEMSCurveFit::kNStatus; ++status)
+    cout << "  " << GEMSCurveFit::statusName(status) << " " << fitter.count(status) << endl;
+  cout << "  mean threshold " << meanThreshold << " noise " << meanNoise << " iterations " << meanIterations << endl;
 
   // Save all objects in this file
   hfile->Write();